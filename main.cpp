@@ -1,511 +1,4467 @@
 #include <iostream>
 
+//~~~~ position.h
+
+#include <cstdint>
+#include <utility>
+
+enum class Side {
+    NoOne,
+    Bot,
+    User,
+};
+
+inline Side Opponent(Side side) {
+    return side == Side::User ? Side::Bot : Side::User;
+}
+
+// Only the 32 dark squares are playable, they are numbered row by row: square = i * 4 + j / 2.
+inline int SquareIndex(int i, int j) {
+    return i * 4 + j / 2;
+}
+
+inline std::pair<int, int> SquareCoords(int square) {
+    int i = square / 4;
+    return std::make_pair(i, (square % 4) * 2 + i % 2);
+}
+
+inline int PopCount(uint32_t mask) {
+    return __builtin_popcount(mask);
+}
+
+inline int LowestSquare(uint32_t mask) {
+    return __builtin_ctz(mask);
+}
+
+enum Direction {
+    DownLeft,
+    DownRight,
+    UpLeft,
+    UpRight,
+};
+
+constexpr uint32_t kEvenRows = 0x0F0F0F0Fu;
+constexpr uint32_t kOddRows = 0xF0F0F0F0u;
+constexpr uint32_t kLeftColumn = 0x11111111u;
+constexpr uint32_t kRightColumn = 0x88888888u;
+constexpr uint32_t kTopRow = 0x0000000Fu;
+constexpr uint32_t kBottomRow = 0xF0000000u;
+
+inline Direction Reverse(Direction direction) {
+    return Direction(direction ^ 3);
+}
+
+// Moves every square of the mask one step along the diagonal. Even and odd rows are shifted by
+// different amounts, squares leaving the board are masked out or fall off the 32-bit word.
+inline uint32_t Step(uint32_t mask, Direction direction) {
+    switch (direction) {
+        case DownLeft:
+            return ((mask & kEvenRows & ~kLeftColumn) << 3) | ((mask & kOddRows) << 4);
+        case DownRight:
+            return ((mask & kEvenRows) << 4) | ((mask & kOddRows & ~kRightColumn) << 5);
+        case UpLeft:
+            return ((mask & kEvenRows & ~kLeftColumn) >> 5) | ((mask & kOddRows) >> 4);
+        default:
+            return ((mask & kEvenRows) >> 4) | ((mask & kOddRows & ~kRightColumn) >> 3);
+    }
+}
+
+inline bool IsForward(Direction direction, Side side) {
+    return side == Side::Bot ? direction == DownLeft || direction == DownRight
+                             : direction == UpLeft || direction == UpRight;
+}
+
+class Position {
+public:
+    uint32_t bot;
+    uint32_t user;
+    uint32_t kings;
+
+    Position() : bot(0), user(0), kings(0) {
+    }
+
+    uint32_t Pieces(Side side) const {
+        return side == Side::Bot ? bot : user;
+    }
+
+    uint32_t Empty() const {
+        return ~(bot | user);
+    }
+
+    Side SideAt(int square) const {
+        uint32_t bit = 1u << square;
+        if (bot & bit) {
+            return Side::Bot;
+        }
+        return user & bit ? Side::User : Side::NoOne;
+    }
+
+    bool IsKing(int square) const {
+        return kings & (1u << square);
+    }
+
+    // Pieces of the side that are allowed to step or jump in the direction before any capture is made.
+    uint32_t Movers(Side side, Direction direction) const {
+        uint32_t own = Pieces(side);
+        return IsForward(direction, side) ? own : own & kings;
+    }
+
+    uint32_t Jumpers(Side side) const {
+        uint32_t empty = Empty();
+        uint32_t opponent = Pieces(Opponent(side));
+        uint32_t jumpers = 0;
+        for (int d = 0; d < 4; ++d) {
+            auto back = Reverse(Direction(d));
+            jumpers |= Movers(side, Direction(d)) & Step(Step(empty, back) & opponent, back);
+        }
+        return jumpers;
+    }
+
+    uint32_t Promotion(Side side) const {
+        return side == Side::Bot ? kBottomRow : kTopRow;
+    }
+};
+
+//~~~~
+
+//~~~~ transposition_table.h
+
+#include <atomic>
+#include <memory>
+#include <random>
+
+class Zobrist {
+public:
+    uint64_t pieces[4][32];
+    uint64_t bot_to_move;
+
+    Zobrist() {
+        std::mt19937_64 generator(0x9E3779B97F4A7C15ull);
+        for (auto &kind: pieces) {
+            for (uint64_t &key: kind) {
+                key = generator();
+            }
+        }
+        bot_to_move = generator();
+    }
+
+    static const Zobrist &Keys() {
+        static const Zobrist keys;
+        return keys;
+    }
+
+    uint64_t Piece(Side side, bool is_king, int square) const {
+        return pieces[(side == Side::User ? 2 : 0) + is_king][square];
+    }
+
+    uint64_t Hash(const Position &position) const {
+        uint64_t hash = 0;
+        for (uint32_t rest = position.bot | position.user; rest; rest &= rest - 1) {
+            int square = LowestSquare(rest);
+            hash ^= Piece(position.SideAt(square), position.IsKing(square), square);
+        }
+        return hash;
+    }
+};
+
+enum class Bound : uint8_t {
+    None,
+    Exact,
+    Lower,
+    Upper,
+};
+
+class TableEntry {
+public:
+    int score = 0;
+    int depth = 0;
+    Bound bound = Bound::None;
+    int from = -1;
+    int to = -1;
+};
+
+// How probes and stores went, counted by every search on its own so threads share nothing but the slots.
+class TableCounters {
+public:
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t overwrites = 0;
+
+    TableCounters &operator+=(const TableCounters &other) {
+        hits += other.hits;
+        misses += other.misses;
+        overwrites += other.overwrites;
+        return *this;
+    }
+};
+
+// Fixed-size always-lock-free table. Every slot keeps the key xor-ed with its data word, so a slot torn by
+// two threads writing at once fails the key check on probe instead of returning a mixed entry.
+class TranspositionTable {
+public:
+    class Slot {
+    public:
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    uint64_t mask;
+
+    explicit TranspositionTable(size_t megabytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Slot) <= megabytes << 20) {
+            count *= 2;
+        }
+        slots.reset(new Slot[count]);
+        mask = count - 1;
+        Clear();
+    }
+
+    size_t Size() const {
+        return mask + 1;
+    }
+
+    void Clear() {
+        for (size_t i = 0; i < Size(); ++i) {
+            slots[i].check.store(0, std::memory_order_relaxed);
+            slots[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static uint64_t Pack(const TableEntry &entry) {
+        return uint64_t(uint32_t(entry.score))
+               | uint64_t(entry.depth & 0xFF) << 32
+               | uint64_t(entry.bound) << 40
+               | uint64_t(entry.from & 0x3F) << 42
+               | uint64_t(entry.to & 0x3F) << 48;
+    }
+
+    static TableEntry Unpack(uint64_t data) {
+        TableEntry entry;
+        entry.score = int(uint32_t(data));
+        entry.depth = int(data >> 32 & 0xFF);
+        entry.bound = Bound(data >> 40 & 0x3);
+        entry.from = data >> 42 & 0x20 ? -1 : int(data >> 42 & 0x3F);
+        entry.to = data >> 48 & 0x20 ? -1 : int(data >> 48 & 0x3F);
+        return entry;
+    }
+
+    bool Probe(uint64_t key, TableEntry *entry, TableCounters *counters = nullptr) {
+        Slot &slot = slots[key & mask];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        uint64_t check = slot.check.load(std::memory_order_relaxed);
+        if ((check ^ data) != key || Bound(data >> 40 & 0x3) == Bound::None) {
+            if (counters) {
+                ++counters->misses;
+            }
+            return false;
+        }
+        if (counters) {
+            ++counters->hits;
+        }
+        *entry = Unpack(data);
+        return true;
+    }
+
+    // Keeps the deeper result for the same position, any other position is replaced.
+    void Store(uint64_t key, const TableEntry &entry, TableCounters *counters = nullptr) {
+        Slot &slot = slots[key & mask];
+        uint64_t old_data = slot.data.load(std::memory_order_relaxed);
+        uint64_t old_check = slot.check.load(std::memory_order_relaxed);
+        if ((old_check ^ old_data) == key) {
+            if (int(old_data >> 32 & 0xFF) > entry.depth) {
+                return;
+            }
+        } else if (counters && Bound(old_data >> 40 & 0x3) != Bound::None) {
+            ++counters->overwrites;
+        }
+        uint64_t data = Pack(entry);
+        slot.data.store(data, std::memory_order_relaxed);
+        slot.check.store(key ^ data, std::memory_order_relaxed);
+    }
+};
+
+//~~~~
+
+//~~~~ evaluation.h
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Scores are from the bot's point of view. Everything that depends on one square only is folded into a
+// piece-square table, so boards can keep that part up to date move by move.
+class Evaluation {
+public:
+    static constexpr int kWin = 100000;
+    static constexpr uint32_t kCentre = 0x00066000u;
+
+    int man = 100;
+    int king = 150;
+    int advancement = 4;
+    int back_rank = 10;
+    int centre = 6;
+    int king_mobility = 3;
+    int tempo = 4;
+    int table[4][32];
+
+    Evaluation() {
+        Build();
+    }
+
+    static Evaluation &Current() {
+        static Evaluation evaluation;
+        return evaluation;
+    }
+
+    void Build() {
+        for (int square = 0; square < 32; ++square) {
+            int row = SquareCoords(square).first;
+            int central = (kCentre >> square & 1) * centre;
+            table[0][square] = man + advancement * row + (row == 0 ? back_rank : 0) + central;
+            table[1][square] = king + central;
+            table[2][square] = -(man + advancement * (7 - row) + (row == 7 ? back_rank : 0) + central);
+            table[3][square] = -(king + central);
+        }
+    }
+
+    // Reads "name value" lines, # starts a comment. Unknown names are reported and skipped; any other line that
+    // is not blank is reported and fails the load, leaving the weights as they were.
+    bool Load(const std::string &path) {
+        std::ifstream file(path);
+        if (!file) {
+            return false;
+        }
+        Evaluation loaded = *this;
+        std::string line;
+        for (int number = 1; std::getline(file, line); ++number) {
+            std::istringstream fields(line.substr(0, line.find('#')));
+            std::string name;
+            int value;
+            std::string rest;
+            if (!(fields >> name)) {
+                continue;
+            }
+            if (!(fields >> value) || fields >> rest) {
+                std::cerr << path << ":" << number << ": expected \"name value\": " << line << "\n";
+                return false;
+            }
+            if (name == "man") {
+                loaded.man = value;
+            } else if (name == "king") {
+                loaded.king = value;
+            } else if (name == "advancement") {
+                loaded.advancement = value;
+            } else if (name == "back_rank") {
+                loaded.back_rank = value;
+            } else if (name == "centre") {
+                loaded.centre = value;
+            } else if (name == "king_mobility") {
+                loaded.king_mobility = value;
+            } else if (name == "tempo") {
+                loaded.tempo = value;
+            } else {
+                std::cerr << "Unknown evaluation weight " << name << "\n";
+            }
+        }
+        *this = loaded;
+        Build();
+        return true;
+    }
+
+    int Piece(Side side, bool is_king, int square) const {
+        return table[(side == Side::User ? 2 : 0) + is_king][square];
+    }
+
+    int PieceSquares(const Position &position) const {
+        int score = 0;
+        for (uint32_t rest = position.bot | position.user; rest; rest &= rest - 1) {
+            int square = LowestSquare(rest);
+            score += Piece(position.SideAt(square), position.IsKing(square), square);
+        }
+        return score;
+    }
+
+    // The terms that depend on neighbouring squares or on the side to move.
+    int Dynamic(const Position &position, Side to_move) const {
+        uint32_t empty = position.Empty();
+        int mobility = 0;
+        for (int d = 0; d < 4; ++d) {
+            mobility += PopCount(Step(position.bot & position.kings, Direction(d)) & empty);
+            mobility -= PopCount(Step(position.user & position.kings, Direction(d)) & empty);
+        }
+        return king_mobility * mobility + (to_move == Side::Bot ? tempo : -tempo);
+    }
+};
+
+//~~~~
+
+//~~~~ network.h
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKERS_X86 1
+#endif
+
+// First-layer sums of a network for one position, kept up to date move by move like the piece-square score.
+class Accumulator {
+public:
+    static constexpr int kSize = 32;
+
+    alignas(32) int16_t values[kSize];
+};
+
+// Small quantised network scoring positions from the bot's point of view. The 128 inputs are the same piece
+// kinds and squares as the piece-square table: 0 bot men, 1 bot kings, 2 user men, 3 user kings. Layers:
+//   128 -> 32 int16, clipped to 0..127 (1.0 is 127)
+//   32 -> 16 int8 weights (1.0 is 64), int32 sums shifted back to the 0..127 scale and clipped
+//   16 -> 1, int8 weights; the sum times kOutputScale / (127 * 64) is the score
+// The hidden layer runs on AVX2 or SSSE3 when the CPU has them, found once at load time.
+class Network {
+public:
+    static constexpr int kInputs = 128;
+    static constexpr int kHidden = Accumulator::kSize;
+    static constexpr int kHidden2 = 16;
+    static constexpr int kOutputScale = 200;
+    static constexpr uint32_t kMagic = 0x4E4E4B43u;
+    static constexpr uint32_t kVersion = 1;
+
+    using HiddenLayer = void (*)(const uint8_t *input, const int8_t *weights, const int32_t *bias, int32_t *output);
+
+    alignas(32) int16_t input_weights[kInputs][kHidden];
+    alignas(32) int16_t input_bias[kHidden];
+    alignas(32) int8_t hidden_weights[kHidden2][kHidden];
+    int32_t hidden_bias[kHidden2];
+    int8_t output_weights[kHidden2];
+    int32_t output_bias;
+    HiddenLayer hidden_layer;
+    const char *kernel;
+
+    Network() : input_weights(), input_bias(), hidden_weights(), hidden_bias(), output_weights(), output_bias(0) {
+        SelectKernel(true);
+    }
+
+    static int Feature(Side side, bool is_king, int square) {
+        return ((side == Side::User ? 2 : 0) + is_king) * 32 + square;
+    }
+
+    static void HiddenScalar(const uint8_t *input, const int8_t *weights, const int32_t *bias, int32_t *output) {
+        for (int o = 0; o < kHidden2; ++o) {
+            int32_t sum = bias[o];
+            for (int i = 0; i < kHidden; ++i) {
+                sum += int32_t(input[i]) * weights[o * kHidden + i];
+            }
+            output[o] = sum;
+        }
+    }
+
+#ifdef CHECKERS_X86
+    // maddubs multiplies unsigned inputs by signed weights into pairwise int16 sums, which cannot saturate
+    // while both stay within 127.
+    __attribute__((target("avx2")))
+    static void HiddenAvx2(const uint8_t *input, const int8_t *weights, const int32_t *bias, int32_t *output) {
+        __m256i in = _mm256_load_si256(reinterpret_cast<const __m256i *>(input));
+        __m256i ones = _mm256_set1_epi16(1);
+        for (int o = 0; o < kHidden2; ++o) {
+            __m256i row = _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + o * kHidden));
+            __m256i sums = _mm256_madd_epi16(_mm256_maddubs_epi16(in, row), ones);
+            __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+            sum = _mm_hadd_epi32(sum, sum);
+            sum = _mm_hadd_epi32(sum, sum);
+            output[o] = bias[o] + _mm_cvtsi128_si32(sum);
+        }
+    }
+
+    __attribute__((target("ssse3")))
+    static void HiddenSsse3(const uint8_t *input, const int8_t *weights, const int32_t *bias, int32_t *output) {
+        __m128i low = _mm_load_si128(reinterpret_cast<const __m128i *>(input));
+        __m128i high = _mm_load_si128(reinterpret_cast<const __m128i *>(input + 16));
+        __m128i ones = _mm_set1_epi16(1);
+        for (int o = 0; o < kHidden2; ++o) {
+            const int8_t *row = weights + o * kHidden;
+            __m128i sum = _mm_add_epi32(
+                    _mm_madd_epi16(_mm_maddubs_epi16(low, _mm_load_si128(reinterpret_cast<const __m128i *>(row))), ones),
+                    _mm_madd_epi16(_mm_maddubs_epi16(high, _mm_load_si128(reinterpret_cast<const __m128i *>(row + 16))),
+                                   ones));
+            sum = _mm_hadd_epi32(sum, sum);
+            sum = _mm_hadd_epi32(sum, sum);
+            output[o] = bias[o] + _mm_cvtsi128_si32(sum);
+        }
+    }
+#endif
+
+    void SelectKernel(bool allow_simd) {
+        hidden_layer = HiddenScalar;
+        kernel = "scalar";
+#ifdef CHECKERS_X86
+        if (allow_simd && __builtin_cpu_supports("avx2")) {
+            hidden_layer = HiddenAvx2;
+            kernel = "avx2";
+        } else if (allow_simd && __builtin_cpu_supports("ssse3")) {
+            hidden_layer = HiddenSsse3;
+            kernel = "ssse3";
+        }
+#endif
+    }
+
+    void Refresh(const Position &position, Accumulator &accumulator) const {
+        std::copy(input_bias, input_bias + kHidden, accumulator.values);
+        for (uint32_t rest = position.bot | position.user; rest; rest &= rest - 1) {
+            int square = LowestSquare(rest);
+            Add(accumulator, Feature(position.SideAt(square), position.IsKing(square), square), 1);
+        }
+    }
+
+    void Add(Accumulator &accumulator, int feature, int sign) const {
+        const int16_t *column = input_weights[feature];
+        for (int i = 0; i < kHidden; ++i) {
+            accumulator.values[i] += int16_t(sign * column[i]);
+        }
+    }
+
+    // Updates the accumulator of position for a move from one square to another capturing eaten.
+    void ApplyMove(Accumulator &accumulator, const Position &position, int from, int to, uint32_t eaten,
+                   bool promotion) const {
+        Side side = position.SideAt(from);
+        bool is_king = position.IsKing(from);
+        Add(accumulator, Feature(side, is_king, from), -1);
+        Add(accumulator, Feature(side, is_king || promotion, to), 1);
+        for (uint32_t rest = eaten; rest; rest &= rest - 1) {
+            int square = LowestSquare(rest);
+            Add(accumulator, Feature(Opponent(side), position.IsKing(square), square), -1);
+        }
+    }
+
+    int Evaluate(const Accumulator &accumulator) const {
+        alignas(32) uint8_t hidden[kHidden];
+        for (int i = 0; i < kHidden; ++i) {
+            hidden[i] = uint8_t(std::min<int16_t>(std::max<int16_t>(accumulator.values[i], 0), 127));
+        }
+        int32_t sums[kHidden2];
+        hidden_layer(hidden, &hidden_weights[0][0], hidden_bias, sums);
+        int64_t output = output_bias;
+        for (int o = 0; o < kHidden2; ++o) {
+            output += int64_t(std::min(std::max(sums[o] >> 6, 0), 127)) * output_weights[o];
+        }
+        return int(output * kOutputScale / (127 * 64));
+    }
+
+    bool Load(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        uint32_t header[2] = {};
+        file.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!file || header[0] != kMagic || header[1] != kVersion) {
+            return false;
+        }
+        file.read(reinterpret_cast<char *>(input_weights), sizeof(input_weights));
+        file.read(reinterpret_cast<char *>(input_bias), sizeof(input_bias));
+        file.read(reinterpret_cast<char *>(hidden_weights), sizeof(hidden_weights));
+        file.read(reinterpret_cast<char *>(hidden_bias), sizeof(hidden_bias));
+        file.read(reinterpret_cast<char *>(output_weights), sizeof(output_weights));
+        file.read(reinterpret_cast<char *>(&output_bias), sizeof(output_bias));
+        return bool(file);
+    }
+
+    bool Save(const std::string &path) const {
+        std::ofstream file(path, std::ios::binary);
+        uint32_t header[2] = {kMagic, kVersion};
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(input_weights), sizeof(input_weights));
+        file.write(reinterpret_cast<const char *>(input_bias), sizeof(input_bias));
+        file.write(reinterpret_cast<const char *>(hidden_weights), sizeof(hidden_weights));
+        file.write(reinterpret_cast<const char *>(hidden_bias), sizeof(hidden_bias));
+        file.write(reinterpret_cast<const char *>(output_weights), sizeof(output_weights));
+        file.write(reinterpret_cast<const char *>(&output_bias), sizeof(output_bias));
+        return bool(file);
+    }
+};
+
+//~~~~
+
+//~~~~ telemetry.h
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+// Build with -DCHECKERS_TELEMETRY=1 to count what the search spends its time on; otherwise the hooks compile to
+// nothing and the search runs exactly as fast as without them.
+#ifndef CHECKERS_TELEMETRY
+#define CHECKERS_TELEMETRY 0
+#endif
+
+// A span is named by a string literal and a number, written out as "<name> <argument>", so recording one in
+// the search allocates nothing.
+class TelemetrySpan {
+public:
+    const char *name;
+    int argument;
+    int64_t start_us;
+    int64_t duration_us;
+    int thread;
+};
+
+// Counters of one search. The search points Current() at its own counters while it runs, so move generation and
+// the evaluation count into them without knowing about the search.
+class Telemetry {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr bool kEnabled = CHECKERS_TELEMETRY;
+    // Cutoffs by the index of the move that caused them, the last slot counts every later index.
+    static constexpr int kCutoffSlots = 8;
+
+    uint64_t nodes = 0;
+    int depth = 0;
+    int max_ply = 0;
+    int64_t ms = 0;
+    uint64_t tt_probes = 0;
+    uint64_t tt_hits = 0;
+    uint64_t cutoffs[kCutoffSlots] = {};
+    uint64_t movegen_calls = 0;
+    uint64_t movegen_ns = 0;
+    uint64_t eval_calls = 0;
+    uint64_t eval_ns = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    std::vector<TelemetrySpan> spans;
+
+    static Telemetry *&Current() {
+        thread_local Telemetry *current = nullptr;
+        return current;
+    }
+
+    // Trace timestamps count from the program start, so the spans of successive searches line up in one file.
+    static inline const Clock::time_point kEpoch = Clock::now();
+
+    static int64_t Microseconds(Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time - kEpoch).count();
+    }
+
+    void Merge(const Telemetry &other) {
+        max_ply = std::max(max_ply, other.max_ply);
+        tt_probes += other.tt_probes;
+        tt_hits += other.tt_hits;
+        for (int i = 0; i < kCutoffSlots; ++i) {
+            cutoffs[i] += other.cutoffs[i];
+        }
+        movegen_calls += other.movegen_calls;
+        movegen_ns += other.movegen_ns;
+        eval_calls += other.eval_calls;
+        eval_ns += other.eval_ns;
+        allocations += other.allocations;
+        allocated_bytes += other.allocated_bytes;
+        spans.insert(spans.end(), other.spans.begin(), other.spans.end());
+    }
+
+    std::string Info() const {
+        uint64_t cutoff_total = 0;
+        for (uint64_t count: cutoffs) {
+            cutoff_total += count;
+        }
+        return "info depth " + std::to_string(depth) + " seldepth " + std::to_string(max_ply) + " nodes "
+               + std::to_string(nodes) + " time " + std::to_string(ms) + " nps "
+               + std::to_string(nodes * 1000 / uint64_t(std::max<int64_t>(ms, 1))) + " tthits "
+               + std::to_string(tt_hits) + "/" + std::to_string(tt_probes) + " firstcut "
+               + std::to_string(cutoff_total ? cutoffs[0] * 100 / cutoff_total : 0) + "% movegen_ms "
+               + std::to_string(movegen_ns / 1000000) + " eval_ms " + std::to_string(eval_ns / 1000000)
+               + " allocations " + std::to_string(allocations);
+    }
+
+    // One line per search: CSV when path ends in .csv, with a header if the file is new, JSON otherwise.
+    bool Append(const std::string &path) const {
+        bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+        bool fresh = !std::ifstream(path).good();
+        std::ofstream out(path, std::ios::app);
+        std::string cutoff_list;
+        for (int i = 0; i < kCutoffSlots; ++i) {
+            cutoff_list += (i ? (csv ? " " : ",") : "") + std::to_string(cutoffs[i]);
+        }
+        if (csv) {
+            if (fresh) {
+                out << "depth,seldepth,nodes,ms,tt_probes,tt_hits,cutoffs,movegen_calls,movegen_ns,eval_calls,"
+                       "eval_ns,allocations,allocated_bytes\n";
+            }
+            out << depth << "," << max_ply << "," << nodes << "," << ms << "," << tt_probes << "," << tt_hits << ","
+                << cutoff_list << "," << movegen_calls << "," << movegen_ns << "," << eval_calls << "," << eval_ns
+                << "," << allocations << "," << allocated_bytes << "\n";
+        } else {
+            out << "{\"depth\":" << depth << ",\"seldepth\":" << max_ply << ",\"nodes\":" << nodes
+                << ",\"ms\":" << ms << ",\"tt_probes\":" << tt_probes << ",\"tt_hits\":" << tt_hits
+                << ",\"cutoffs\":[" << cutoff_list << "],\"movegen_calls\":" << movegen_calls
+                << ",\"movegen_ns\":" << movegen_ns << ",\"eval_calls\":" << eval_calls << ",\"eval_ns\":" << eval_ns
+                << ",\"allocations\":" << allocations << ",\"allocated_bytes\":" << allocated_bytes << "}\n";
+        }
+        return bool(out);
+    }
+
+    void Write(const std::string &telemetry_path, const std::string &trace_path) const;
+
+    // Chrome trace-viewer events in the JSON array format, whose closing bracket is optional, so every search
+    // appends its spans to the same file.
+    bool AppendTrace(const std::string &path) const {
+        bool fresh = !std::ifstream(path).good();
+        std::ofstream out(path, std::ios::app);
+        if (fresh) {
+            out << "[\n";
+        }
+        for (const TelemetrySpan &span: spans) {
+            out << "{\"name\":\"" << span.name << " " << span.argument << "\",\"ph\":\"X\",\"ts\":" << span.start_us
+                << ",\"dur\":" << span.duration_us << ",\"pid\":1,\"tid\":" << span.thread << "},\n";
+        }
+        return bool(out);
+    }
+};
+
+// Nothing is written with telemetry compiled out or for empty paths. Searches running at the same time write
+// one after the other, so their lines do not interleave and only the first writes the trace header.
+inline void Telemetry::Write(const std::string &telemetry_path, const std::string &trace_path) const {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (kEnabled && !telemetry_path.empty()) {
+        Append(telemetry_path);
+    }
+    if (kEnabled && !trace_path.empty()) {
+        AppendTrace(trace_path);
+    }
+}
+
+// Adds its lifetime and one call to counters of the current telemetry, if there is one.
+class TelemetryTimer {
+public:
+    Telemetry *telemetry;
+    uint64_t Telemetry::*ns;
+    uint64_t Telemetry::*calls;
+    Telemetry::Clock::time_point start;
+
+    TelemetryTimer(uint64_t Telemetry::*new_ns, uint64_t Telemetry::*new_calls)
+            : telemetry(Telemetry::Current()), ns(new_ns), calls(new_calls) {
+        if (telemetry) {
+            start = Telemetry::Clock::now();
+        }
+    }
+
+    ~TelemetryTimer() {
+        if (telemetry) {
+            telemetry->*ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Telemetry::Clock::now() - start)
+                                      .count();
+            ++(telemetry->*calls);
+        }
+    }
+};
+
+// Records a trace span of the current telemetry from construction to destruction.
+class TelemetryScope {
+public:
+    Telemetry *telemetry;
+    const char *name;
+    int argument;
+    int thread;
+    Telemetry::Clock::time_point start;
+
+    TelemetryScope(const char *new_name, int new_argument, int new_thread)
+            : telemetry(Telemetry::Current()), name(new_name), argument(new_argument), thread(new_thread),
+              start(Telemetry::Clock::now()) {
+    }
+
+    ~TelemetryScope() {
+        if (telemetry) {
+            int64_t start_us = Telemetry::Microseconds(start);
+            telemetry->spans.push_back(
+                    {name, argument, start_us, Telemetry::Microseconds(Telemetry::Clock::now()) - start_us, thread});
+        }
+    }
+};
+
+#if CHECKERS_TELEMETRY
+#define TELEMETRY_COUNT(statement)                          \
+    do {                                                    \
+        if (Telemetry *current = Telemetry::Current()) {    \
+            current->statement;                             \
+        }                                                   \
+    } while (0)
+#define TELEMETRY_TIMER(ns, calls) TelemetryTimer telemetry_timer(&Telemetry::ns, &Telemetry::calls)
+#define TELEMETRY_SPAN(name, argument, thread) TelemetryScope telemetry_scope(name, argument, thread)
+
+// Counts every allocation of a thread that is searching.
+void *operator new(size_t size) {
+    TELEMETRY_COUNT(allocated_bytes += size);
+    TELEMETRY_COUNT(allocations++);
+    if (void *memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+// Not inlined, so the compiler does not pair std::free with the new expressions it was inlined into.
+__attribute__((noinline)) void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, size_t) noexcept {
+    std::free(memory);
+}
+#else
+#define TELEMETRY_COUNT(statement) \
+    do {                           \
+    } while (0)
+#define TELEMETRY_TIMER(ns, calls)
+#define TELEMETRY_SPAN(name, argument, thread)
+#endif
+
+//~~~~
+
 //~~~~ board.h
 
-#include <random>
-#include <memory>
-#include <utility>
-#include <vector>
-#include <queue>
-#include <set>
-#include <limits>
+#include <algorithm>
+#include <random>
+#include <memory>
+#include <vector>
+#include <queue>
+#include <set>
+#include <limits>
+#include <string>
+
+// Plain value type: squares are 0..31, eaten is the mask of the captured squares.
+class Move {
+public:
+    uint32_t eaten;
+    uint8_t from;
+    uint8_t final_square;
+    bool promotion;
+
+    Move() = default;
+
+    Move(int new_from, int new_final_square, uint32_t new_eaten, bool new_promotion) : eaten(new_eaten),
+                                                                                      from(new_from),
+                                                                                      final_square(
+                                                                                              new_final_square),
+                                                                                      promotion(new_promotion) {
+    }
+};
+
+// Fixed-capacity list of moves that lives on the stack of the search.
+class MoveList {
+public:
+    static constexpr int kCapacity = 256;
+
+    Move moves[kCapacity];
+    int count = 0;
+
+    void push_back(const Move &move) {
+        if (count < kCapacity) {
+            moves[count++] = move;
+        }
+    }
+
+    Move *begin() {
+        return moves;
+    }
+
+    Move *end() {
+        return moves + count;
+    }
+
+    const Move *begin() const {
+        return moves;
+    }
+
+    const Move *end() const {
+        return moves + count;
+    }
+
+    Move &front() {
+        return moves[0];
+    }
+
+    Move &operator[](size_t index) {
+        return moves[index];
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+
+class SearchLimits;
+class SearchResult;
+class Tablebase;
+class OpeningBook;
+class OrderingTables;
+class ClusterCoordinator;
+
+// Everything ImplementMove destroys and UndoMove needs to put back.
+class MoveUndo {
+public:
+    uint32_t eaten;
+    uint32_t eaten_kings;
+    size_t bot_kings;
+    size_t user_kings;
+    uint64_t hash;
+    int eval;
+    Accumulator accumulator;
+
+    MoveUndo(uint32_t new_eaten, uint32_t new_eaten_kings, size_t new_bot_kings, size_t new_user_kings,
+             uint64_t new_hash, int new_eval)
+            : eaten(new_eaten),
+              eaten_kings(new_eaten_kings),
+              bot_kings(new_bot_kings),
+              user_kings(new_user_kings),
+              hash(new_hash),
+              eval(new_eval) {
+    }
+};
+
+class Board {
+public:
+    Position position;
+    size_t bot_kings;
+    size_t user_kings;
+    uint64_t hash;
+    // Piece-square part of the evaluation, kept up to date by ImplementMove and UndoMove.
+    int eval;
+    // With a network the evaluation is the network's instead, from the accumulator kept up to date the same way.
+    std::shared_ptr<const Network> network;
+    Accumulator accumulator;
+    std::shared_ptr<TranspositionTable> table;
+    std::shared_ptr<const Tablebase> tablebase;
+    std::shared_ptr<const OpeningBook> book;
+    // Killers and history kept between the bot's turns, see ParallelSearch.
+    std::shared_ptr<OrderingTables> ordering;
+
+    Board() : bot_kings(0),
+              user_kings(0) {
+        for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 8; ++j) {
+                if (i < 3 && (i + j) % 2 == 0) {
+                    position.bot |= 1u << SquareIndex(i, j);
+                } else if (i >= 5 && (i + j) % 2 == 0) {
+                    position.user |= 1u << SquareIndex(i, j);
+                }
+            }
+        }
+        hash = Zobrist::Keys().Hash(position);
+        eval = Evaluation::Current().PieceSquares(position);
+    }
+
+    Board(const Board &other) = default;
+
+    void SetNetwork(const std::shared_ptr<const Network> &new_network) {
+        network = new_network;
+        if (network) {
+            network->Refresh(position, accumulator);
+        }
+    }
+
+    // One character per playable square in square order: b and B are bot men and kings, u and U are user
+    // men and kings, anything else is an empty square.
+    static Board FromString(const std::string &squares) {
+        Board board;
+        board.position = Position();
+        for (int square = 0; square < 32 && square < int(squares.size()); ++square) {
+            char piece = squares[square];
+            if (piece == 'b' || piece == 'B') {
+                board.position.bot |= 1u << square;
+            } else if (piece == 'u' || piece == 'U') {
+                board.position.user |= 1u << square;
+            }
+            if (piece == 'B' || piece == 'U') {
+                board.position.kings |= 1u << square;
+            }
+        }
+        board.bot_kings = PopCount(board.position.bot & board.position.kings);
+        board.user_kings = PopCount(board.position.user & board.position.kings);
+        board.hash = Zobrist::Keys().Hash(board.position);
+        board.eval = Evaluation::Current().PieceSquares(board.position);
+        return board;
+    }
+
+    std::string ToString() const {
+        std::string squares(32, '.');
+        for (int square = 0; square < 32; ++square) {
+            Side side = position.SideAt(square);
+            if (side != Side::NoOne) {
+                squares[square] = side == Side::Bot ? (position.IsKing(square) ? 'B' : 'b')
+                                                    : (position.IsKing(square) ? 'U' : 'u');
+            }
+        }
+        return squares;
+    }
+
+    Side SideAt(int i, int j) const {
+        if ((i + j) % 2 != 0) {
+            return Side::NoOne;
+        }
+        return position.SideAt(SquareIndex(i, j));
+    }
+
+    bool IsKing(int i, int j) const {
+        return (i + j) % 2 == 0 && position.IsKing(SquareIndex(i, j));
+    }
+
+    uint64_t Key(Side to_move) const {
+        return to_move == Side::Bot ? hash ^ Zobrist::Keys().bot_to_move : hash;
+    }
+
+    MoveList CurrentMoves(Side side) const {
+        TELEMETRY_TIMER(movegen_ns, movegen_calls);
+        MoveList moves;
+        uint32_t jumpers = position.Jumpers(side);
+
+        if (jumpers == 0) {
+            uint32_t empty = position.Empty();
+            for (int d = 0; d < 4; ++d) {
+                auto direction = Direction(d);
+                uint32_t targets = Step(position.Movers(side, direction), direction) & empty;
+                while (targets) {
+                    int to = LowestSquare(targets);
+                    targets &= targets - 1;
+                    int from = LowestSquare(Step(1u << to, Reverse(direction)));
+                    bool promotion = !position.IsKing(from) && (1u << to) & position.Promotion(side);
+                    moves.push_back(Move(from, to, 0, promotion));
+                }
+            }
+            return moves;
+        }
+
+        while (jumpers) {
+            int from = LowestSquare(jumpers);
+            jumpers &= jumpers - 1;
+            AddJumps(side, from, from, 0, position.IsKing(from), moves);
+        }
+        return moves;
+    }
+
+    // Extends a capture sequence from square by every available jump. A sequence ends when no more jumps
+    // are available; men may capture backwards once the sequence has started.
+    void AddJumps(Side side, int from, int square, uint32_t eaten, bool any_direction, MoveList &moves) const {
+        uint32_t opponent = position.Pieces(Opponent(side)) & ~eaten;
+        uint32_t empty = position.Empty() | (1u << from);
+        bool extended = false;
+
+        for (int d = 0; d < 4; ++d) {
+            auto direction = Direction(d);
+            if (!any_direction && !IsForward(direction, side)) {
+                continue;
+            }
+            uint32_t over = Step(1u << square, direction) & opponent;
+            uint32_t landing = Step(over, direction) & empty;
+            if (landing) {
+                extended = true;
+                AddJumps(side, from, LowestSquare(landing), eaten | over, true, moves);
+            }
+        }
+
+        if (!extended && eaten) {
+            bool promotion = !position.IsKing(from) && (1u << square) & position.Promotion(side);
+            moves.push_back(Move(from, square, eaten, promotion));
+        }
+    }
+
+    MoveUndo ImplementMove(Move *move) {
+        uint32_t from = 1u << move->from;
+        uint32_t to = 1u << move->final_square;
+        uint32_t eaten = move->eaten;
+        Side side = position.SideAt(move->from);
+        bool is_king = position.kings & from;
+        MoveUndo undo(eaten, eaten & position.kings, bot_kings, user_kings, hash, eval);
+        const Zobrist &keys = Zobrist::Keys();
+
+        eval += MoveDelta(*move);
+        if (network) {
+            undo.accumulator = accumulator;
+            network->ApplyMove(accumulator, position, move->from, move->final_square, eaten, move->promotion);
+        }
+        hash ^= keys.Piece(side, is_king, move->from);
+        for (uint32_t rest = eaten; rest; rest &= rest - 1) {
+            int square = LowestSquare(rest);
+            hash ^= keys.Piece(Opponent(side), position.IsKing(square), square);
+        }
+
+        if (side == Side::User) {
+            bot_kings -= PopCount(eaten & position.kings);
+            position.bot &= ~eaten;
+            position.user = (position.user & ~from) | to;
+        } else {
+            user_kings -= PopCount(eaten & position.kings);
+            position.user &= ~eaten;
+            position.bot = (position.bot & ~from) | to;
+        }
+        position.kings &= ~eaten;
+
+        if (is_king) {
+            position.kings = (position.kings & ~from) | to;
+        } else if (move->promotion) {
+            position.kings |= to;
+            ++(side == Side::User ? user_kings : bot_kings);
+        }
+        hash ^= keys.Piece(side, position.kings & to, move->final_square);
+        return undo;
+    }
+
+    // Exact inverse of ImplementMove, the board must be in the state ImplementMove left it in.
+    void UndoMove(const Move &move, const MoveUndo &undo) {
+        uint32_t from = 1u << move.from;
+        uint32_t to = 1u << move.final_square;
+
+        if (move.promotion) {
+            position.kings &= ~to;
+        } else if (position.kings & to) {
+            position.kings = (position.kings & ~to) | from;
+        }
+
+        if (position.user & to) {
+            position.user = (position.user & ~to) | from;
+            position.bot |= undo.eaten;
+        } else {
+            position.bot = (position.bot & ~to) | from;
+            position.user |= undo.eaten;
+        }
+        position.kings |= undo.eaten_kings;
+        bot_kings = undo.bot_kings;
+        user_kings = undo.user_kings;
+        hash = undo.hash;
+        eval = undo.eval;
+        if (network) {
+            accumulator = undo.accumulator;
+        }
+    }
+
+    // Change of the piece-square evaluation the move makes, computed without making it.
+    int MoveDelta(const Move &move) const {
+        const Evaluation &evaluation = Evaluation::Current();
+        Side side = position.SideAt(move.from);
+        bool is_king = position.IsKing(move.from);
+        int delta = evaluation.Piece(side, is_king || move.promotion, move.final_square)
+                    - evaluation.Piece(side, is_king, move.from);
+        for (uint32_t rest = move.eaten; rest; rest &= rest - 1) {
+            int square = LowestSquare(rest);
+            delta -= evaluation.Piece(Opponent(side), position.IsKing(square), square);
+        }
+        return delta;
+    }
+
+    Position PositionAfter(const Move &move) const {
+        Position after = position;
+        uint32_t from = 1u << move.from;
+        uint32_t to = 1u << move.final_square;
+        uint32_t &own = position.bot & from ? after.bot : after.user;
+        uint32_t &opponent = position.bot & from ? after.user : after.bot;
+        own = (own & ~from) | to;
+        opponent &= ~move.eaten;
+        after.kings &= ~move.eaten;
+        if ((position.kings & from) || move.promotion) {
+            after.kings = (after.kings & ~from) | to;
+        }
+        return after;
+    }
+
+    int Score(Side to_move) const {
+        TELEMETRY_TIMER(eval_ns, eval_calls);
+        if (network) {
+            return network->Evaluate(accumulator);
+        }
+        return eval + Evaluation::Current().Dynamic(position, to_move);
+    }
+
+    // Static evaluation of the position after move, without making the move.
+    static int SimulateMoveAndScore(const Board &board, const Move &move) {
+        TELEMETRY_TIMER(eval_ns, eval_calls);
+        if (board.network) {
+            Accumulator after = board.accumulator;
+            board.network->ApplyMove(after, board.position, move.from, move.final_square, move.eaten, move.promotion);
+            return board.network->Evaluate(after);
+        }
+        Side side = board.position.SideAt(move.from);
+        return board.eval + board.MoveDelta(move)
+               + Evaluation::Current().Dynamic(board.PositionAfter(move), Opponent(side));
+    }
+
+    static void PrintMove(const char *prefix, const Move &move) {
+        auto [i_from, j_from] = SquareCoords(move.from);
+        auto [i_to, j_to] = SquareCoords(move.final_square);
+        std::cout << prefix << "(" << i_from << ", " << j_from << ") to (" << i_to << ", " << j_to << ")\n";
+    }
+
+    // Squares of the move joined by x for captures and - otherwise, as in "9x18" or "21-17".
+    static std::string MoveText(const Move &move) {
+        return std::to_string(move.from) + (move.eaten ? "x" : "-") + std::to_string(move.final_square);
+    }
+
+    static void PrintEaten(const Move &move) {
+        if (move.eaten) {
+            std::cout << "Pieces eaten: ";
+            for (uint32_t rest = move.eaten; rest; rest &= rest - 1) {
+                auto [i_eaten, j_eaten] = SquareCoords(LowestSquare(rest));
+                std::cout << "(" << i_eaten << ", " << j_eaten << ") ";
+            }
+            std::cout << "\n";
+        }
+    }
+
+    // Plays the bot's move and stores the search result if one was made. A pondered result for this position
+    // is played without searching again. With a cluster the root moves are split over its workers.
+    bool BotMove(const SearchLimits &limits, SearchResult *searched = nullptr,
+                 const SearchResult *pondered = nullptr, ClusterCoordinator *cluster = nullptr);
+
+    bool PlayerMove() {
+        auto moves = CurrentMoves(Side::User);
+
+        if (moves.empty()) {
+            return false;
+        }
+
+        std::cout << "Possible moves:\n";
+        for (Move &move: moves) {
+            PrintMove("From ", move);
+        }
+
+        Move *chosen_move = nullptr;
+        while (chosen_move == nullptr) {
+            std::string from, to;
+            if (!(std::cin >> from >> to)) {
+                return false;
+            }
+            int i_from = from[0] - 48;
+            int j_from = from[1] - 48;
+            int i_to = to[0] - 48;
+            int j_to = to[1] - 48;
+            for (Move &move: moves) {
+                if (SquareCoords(move.from) == std::make_pair(i_from, j_from)
+                    && SquareCoords(move.final_square) == std::make_pair(i_to, j_to)) {
+                    chosen_move = &move;
+                    break;
+                }
+            }
+            if (chosen_move == nullptr) {
+                std::cout << "Try again!\n";
+            }
+        }
+
+        PrintMove("Made ", *chosen_move);
+        PrintEaten(*chosen_move);
+
+        ImplementMove(chosen_move);
+        return true;
+    }
+};
+
+//~~~~
+
+//~~~~ mapped_file.h
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only mapping of a whole file, unmapped on destruction.
+class MappedFile {
+public:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &other) = delete;
+
+    ~MappedFile() {
+        Close();
+    }
+
+    bool Open(const std::string &path) {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        void *address = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            address = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (address == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<const uint8_t *>(address);
+        size = size_t(info.st_size);
+        return true;
+    }
+
+    void Close() {
+        if (data) {
+            munmap(const_cast<uint8_t *>(data), size);
+        }
+        data = nullptr;
+        size = 0;
+    }
+};
+
+//~~~~
+
+//~~~~ tablebase.h
+
+#include <cstring>
+#include <thread>
+
+// Win/loss/draw database of every position with up to `pieces` pieces. A position is indexed by the set of
+// occupied squares, the kind of every piece in square order and the side to move, and takes one byte: 0 is a
+// draw or a position that cannot occur, any other value v means the side to move wins (v - 1 odd) or loses
+// (v - 1 even) in v - 1 plies. The file is a header followed by the bytes and is mapped read-only, so probes
+// are plain loads that need no locking.
+class Tablebase {
+public:
+    static constexpr int kMaxPieces = 6;
+    static constexpr uint32_t kMagic = 0x42544B43u;
+    static constexpr uint32_t kVersion = 1;
+
+    class Header {
+    public:
+        uint32_t magic;
+        uint32_t version;
+        uint32_t pieces;
+        uint32_t reserved;
+        uint64_t offsets[kMaxPieces + 2];
+    };
+
+    int pieces = 0;
+    uint64_t offsets[kMaxPieces + 2] = {};
+    const uint8_t *data = nullptr;
+    std::vector<uint8_t> storage;
+    MappedFile file;
+
+    static uint64_t Binomial(int n, int k) {
+        static const auto table = [] {
+            std::vector<std::vector<uint64_t>> values(33, std::vector<uint64_t>(kMaxPieces + 1, 0));
+            for (int i = 0; i <= 32; ++i) {
+                values[i][0] = 1;
+                for (int j = 1; j <= std::min(i, kMaxPieces); ++j) {
+                    values[i][j] = values[i - 1][j - 1] + (j < i ? values[i - 1][j] : 0);
+                }
+            }
+            return values;
+        }();
+        return table[n][k];
+    }
+
+    static uint64_t SliceSize(int count) {
+        return Binomial(32, count) << (2 * count + 1);
+    }
+
+    // Men standing on their own promotion row cannot occur.
+    static bool IsValid(const Position &position) {
+        uint32_t men = ~position.kings;
+        return !(position.bot & men & kBottomRow) && !(position.user & men & kTopRow);
+    }
+
+    bool Covers(const Position &position) const {
+        int count = PopCount(position.bot | position.user);
+        return data && count > 0 && count <= pieces;
+    }
+
+    uint64_t Index(const Position &position, Side to_move) const {
+        uint32_t occupied = position.bot | position.user;
+        int count = PopCount(occupied);
+        uint64_t combination = 0;
+        uint64_t kinds = 0;
+        int i = 0;
+        for (uint32_t rest = occupied; rest; rest &= rest - 1, ++i) {
+            int square = LowestSquare(rest);
+            combination += Binomial(square, i + 1);
+            kinds = kinds << 2 | (position.user >> square & 1) << 1 | (position.kings >> square & 1);
+        }
+        return offsets[count] + ((combination << 2 * count | kinds) << 1 | (to_move == Side::Bot));
+    }
+
+    // Inverse of Index within the slice of count pieces.
+    static Position Decode(int count, uint64_t index, Side *to_move) {
+        *to_move = index & 1 ? Side::Bot : Side::User;
+        index >>= 1;
+        uint64_t kinds = index & ((1ull << 2 * count) - 1);
+        uint64_t combination = index >> 2 * count;
+        Position position;
+        int square = 31;
+        for (int i = count; i > 0; --i) {
+            while (Binomial(square, i) > combination) {
+                --square;
+            }
+            combination -= Binomial(square, i);
+            int kind = int(kinds >> 2 * (count - i) & 3);
+            (kind & 2 ? position.user : position.bot) |= 1u << square;
+            position.kings |= uint32_t(kind & 1) << square;
+            --square;
+        }
+        return position;
+    }
+
+    bool Probe(const Position &position, Side to_move, uint8_t *value) const {
+        if (!Covers(position)) {
+            return false;
+        }
+        *value = data[Index(position, to_move)];
+        return true;
+    }
+
+    // Score of a probed value for the side to move at ply, from the bot's point of view, on the same scale as
+    // a side left without moves in the search.
+    static int Score(uint8_t value, Side to_move, int ply) {
+        if (value == 0) {
+            return 0;
+        }
+        int distance = value - 1;
+        Side winner = distance % 2 ? to_move : Opponent(to_move);
+        int score = Evaluation::kWin - ply - distance;
+        return winner == Side::Bot ? score : -score;
+    }
+
+    // Index of the move with the best database value for side, or -1 if the position is not a decided one.
+    int BestMove(const Board &board, const MoveList &moves, Side side) const {
+        uint8_t value;
+        if (!Probe(board.position, side, &value) || value == 0) {
+            return -1;
+        }
+        int best_index = -1;
+        int best_score = 0;
+        for (size_t i = 0; i < moves.size(); ++i) {
+            uint8_t after;
+            if (!Probe(board.PositionAfter(moves.moves[i]), Opponent(side), &after)) {
+                return -1;
+            }
+            int score = Score(after, Opponent(side), 1);
+            if (best_index < 0 || (side == Side::Bot ? score > best_score : score < best_score)) {
+                best_index = int(i);
+                best_score = score;
+            }
+        }
+        return best_index;
+    }
+
+    // Retrograde analysis, smallest slices first. Pass p resolves the positions of the slice that are lost in p
+    // plies (p even) or won in p plies (p odd); captures lead into smaller slices that are already complete.
+    // Each pass splits the slice between the threads, which collect their results and apply them after the
+    // join, so no thread reads a value written in the same pass.
+    void Generate(int new_pieces, int threads) {
+        pieces = std::min(new_pieces, kMaxPieces);
+        offsets[1] = 0;
+        for (int count = 1; count <= pieces; ++count) {
+            offsets[count + 1] = offsets[count] + SliceSize(count);
+        }
+        storage.assign(offsets[pieces + 1], 0);
+        data = storage.data();
+        for (int count = 1; count <= pieces; ++count) {
+            GenerateSlice(count, std::max(threads, 1));
+        }
+    }
+
+    void GenerateSlice(int count, int threads) {
+        uint64_t size = SliceSize(count);
+        int longest_before = 0;
+        for (uint64_t i = 0; i < offsets[count]; ++i) {
+            longest_before = std::max(longest_before, int(storage[i]));
+        }
+
+        int empty_passes = 0;
+        for (int pass = 0; pass < 255 && (empty_passes < 2 || pass <= longest_before + 1); ++pass) {
+            std::vector<std::vector<uint64_t>> found(threads);
+            std::vector<std::thread> workers;
+            for (int id = 0; id < threads; ++id) {
+                workers.emplace_back([this, &found, count, size, pass, threads, id]() {
+                    Board board;
+                    for (uint64_t local = size * id / threads; local < size * (id + 1) / threads; ++local) {
+                        if (data[offsets[count] + local] == 0 && Resolves(board, count, local, pass)) {
+                            found[id].push_back(offsets[count] + local);
+                        }
+                    }
+                });
+            }
+            size_t resolved = 0;
+            for (int id = 0; id < threads; ++id) {
+                workers[id].join();
+                for (uint64_t index: found[id]) {
+                    storage[index] = uint8_t(pass + 1);
+                }
+                resolved += found[id].size();
+            }
+            empty_passes = resolved ? 0 : empty_passes + 1;
+            if (resolved) {
+                std::cerr << count << " pieces, " << pass << " plies: " << resolved << " positions\n";
+            }
+        }
+    }
+
+    // Whether the unresolved position is won (odd pass) or lost (even pass) in exactly pass plies.
+    bool Resolves(Board &board, int count, uint64_t local, int pass) const {
+        Side side;
+        board.position = Decode(count, local, &side);
+        if (!IsValid(board.position)) {
+            return false;
+        }
+        auto moves = board.CurrentMoves(side);
+        for (const Move &move: moves) {
+            uint8_t value = data[Index(board.PositionAfter(move), Opponent(side))];
+            int distance = value - 1;
+            if (pass % 2) {
+                if (value && distance % 2 == 0 && distance == pass - 1) {
+                    return true;
+                }
+            } else if (!value || distance % 2 == 0 || distance >= pass) {
+                return false;
+            }
+        }
+        return pass % 2 == 0;
+    }
+
+    bool Save(const std::string &path) const {
+        Header header = {kMagic, kVersion, uint32_t(pieces), 0, {}};
+        std::copy(offsets, offsets + kMaxPieces + 2, header.offsets);
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(data), std::streamsize(offsets[pieces + 1]));
+        return bool(out);
+    }
+
+    bool Load(const std::string &path) {
+        if (!file.Open(path) || file.size < sizeof(Header)) {
+            return false;
+        }
+        Header header;
+        std::memcpy(&header, file.data, sizeof(header));
+        if (header.magic != kMagic || header.version != kVersion || header.pieces < 1
+            || header.pieces > uint32_t(kMaxPieces) || sizeof(Header) + header.offsets[header.pieces + 1] != file.size) {
+            file.Close();
+            return false;
+        }
+        pieces = int(header.pieces);
+        std::copy(header.offsets, header.offsets + kMaxPieces + 2, offsets);
+        data = file.data + sizeof(Header);
+        return true;
+    }
+};
+
+//~~~~
+
+//~~~~ opening_book.h
+
+// Sorted array of fixed-size entries keyed by Board::Key of a bot-to-move position. Lookups binary search
+// the mapped file directly.
+class OpeningBook {
+public:
+    static constexpr uint32_t kMagic = 0x4B4F4243u;
+    static constexpr uint32_t kVersion = 1;
+
+    class Header {
+    public:
+        uint32_t magic;
+        uint32_t version;
+        uint64_t count;
+    };
+
+    class Entry {
+    public:
+        uint64_t key;
+        int32_t score;
+        uint8_t from;
+        uint8_t to;
+        uint8_t depth;
+        uint8_t reserved;
+
+        bool operator<(const Entry &other) const {
+            return key < other.key;
+        }
+    };
+
+    const Entry *entries = nullptr;
+    size_t count = 0;
+    std::vector<Entry> storage;
+    MappedFile file;
+
+    const Entry *Lookup(uint64_t key) const {
+        Entry probe = {key, 0, 0, 0, 0, 0};
+        const Entry *it = std::lower_bound(entries, entries + count, probe);
+        return it != entries + count && it->key == key ? it : nullptr;
+    }
+
+    // Index of the book move among moves, or -1 if the position is not in the book.
+    int BestMove(const Board &board, const MoveList &moves, const Entry **entry) const {
+        *entry = Lookup(board.Key(Side::Bot));
+        if (*entry == nullptr) {
+            return -1;
+        }
+        for (size_t i = 0; i < moves.size(); ++i) {
+            if (moves.moves[i].from == (*entry)->from && moves.moves[i].final_square == (*entry)->to) {
+                return int(i);
+            }
+        }
+        return -1;
+    }
+
+    void Add(const Entry &entry) {
+        storage.push_back(entry);
+    }
+
+    bool Save(const std::string &path) {
+        std::sort(storage.begin(), storage.end());
+        Header header = {kMagic, kVersion, storage.size()};
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(storage.data()), std::streamsize(storage.size() * sizeof(Entry)));
+        return bool(out);
+    }
+
+    bool Load(const std::string &path) {
+        if (!file.Open(path) || file.size < sizeof(Header)) {
+            return false;
+        }
+        Header header;
+        std::memcpy(&header, file.data, sizeof(header));
+        if (header.magic != kMagic || header.version != kVersion
+            || sizeof(Header) + header.count * sizeof(Entry) != file.size) {
+            file.Close();
+            return false;
+        }
+        entries = reinterpret_cast<const Entry *>(file.data + sizeof(Header));
+        count = header.count;
+        return true;
+    }
+};
+
+//~~~~
+
+//~~~~ perft.h
+
+#include <chrono>
+
+// Counts the leaf nodes of the move tree, the last ply is counted without being played.
+inline uint64_t Perft(Board &board, Side side, int depth) {
+    if (depth == 0) {
+        return 1;
+    }
+    auto moves = board.CurrentMoves(side);
+    if (depth == 1) {
+        return moves.size();
+    }
+    uint64_t nodes = 0;
+    for (Move &move: moves) {
+        auto undo = board.ImplementMove(&move);
+        nodes += Perft(board, Opponent(side), depth - 1);
+        board.UndoMove(move, undo);
+    }
+    return nodes;
+}
+
+class PerftPosition {
+public:
+    const char *name;
+    const char *squares;
+    Side side;
+    std::vector<uint64_t> expected;
+};
+
+inline const std::vector<PerftPosition> &PerftSuite() {
+    static const std::vector<PerftPosition> suite = {
+            {"start", "bbbbbbbbbbbb........uuuuuuuuuuuu", Side::User,
+             {7, 49, 302, 1469, 7493, 38110, 191466, 939165, 4634579, 22852407, 113383993}},
+            {"double-jump", ".............bb.....bb...u......", Side::User,
+             {3, 14, 22, 89, 164, 714, 1204, 5405, 15238, 72758, 165955, 752295}},
+            {"branching", ".........bb..b...b..b...uu......", Side::User,
+             {1, 5, 8, 16, 23, 44, 72, 196, 467, 1582, 5153, 21155}},
+            {"promotion", "....u......b..............b.....", Side::User,
+             {2, 8, 12, 45, 180, 768, 1884, 8669, 33731, 157959, 428271, 1816216}},
+            {"jump-to-crown", ".....bb..u.....b........u.......", Side::User,
+             {1, 1, 3, 6, 18, 27, 90, 180, 660, 1100, 4400, 17300}},
+            {"kings", "..B......bb..U...bb...b...U.....", Side::Bot,
+             {1, 4, 31, 114, 923, 2259, 17528, 48597, 397620, 1021426, 8328155, 22795730}},
+            {"midgame", "bbb.b.bbb.bbbb.u.bu.u.uuuu.uu.u.", Side::User,
+             {1, 8, 14, 53, 212, 1017, 4009, 17866, 72765, 313522, 1297428, 5610095}},
+    };
+    return suite;
+}
+
+// Compares the counts of every suite position up to max_depth with the reference values and reports the speed.
+// The references agree with the old deque-based generator wherever no capture sequence passes back over its
+// origin square. Returns false if any count differs.
+inline bool RunPerft(int max_depth) {
+    bool ok = true;
+    std::cout << "position,depth,nodes,expected,ms,nps,status\n";
+    for (const PerftPosition &entry: PerftSuite()) {
+        Board board = Board::FromString(entry.squares);
+        for (int depth = 1; depth <= std::min(max_depth, int(entry.expected.size())); ++depth) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t nodes = Perft(board, entry.side, depth);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            bool match = nodes == entry.expected[depth - 1];
+            ok = ok && match;
+            std::cout << entry.name << "," << depth << "," << nodes << "," << entry.expected[depth - 1] << ","
+                      << int64_t(ms) << "," << uint64_t(nodes / (ms / 1000 + 1e-9)) << ","
+                      << (match ? "ok" : "FAIL") << "\n";
+        }
+    }
+    return ok;
+}
+
+//~~~~
+
+//~~~~ search.h
+
+#include <chrono>
+#include <functional>
+#include <thread>
+
+class SearchLimits {
+public:
+    int max_depth = 64;
+    int threads = 1;
+    // Stops the search like the hard deadline does once this many nodes were visited, 0 means no limit.
+    uint64_t max_nodes = 0;
+    // Raised by another thread to stop the search like the hard deadline does.
+    const std::atomic<bool> *stop = nullptr;
+    // Called by the main thread with the result so far after every completed depth.
+    std::function<void(const SearchResult &)> on_iteration;
+    // No new iteration is started once soft_ms have passed, the running one is abandoned at hard_ms.
+    int soft_ms = 500;
+    int hard_ms = 1000;
+    // Null-window search of every move after the first, re-searched with the full window when it fails high.
+    bool pvs = true;
+    // Half-width of the root window around the previous iteration's score, 0 searches every depth with a full
+    // window. A root search that fails outside the window widens it by aspiration_growth and tries again; a
+    // growth that does not widen it (below 2) or a half-width past kMaxAspiration opens that side of the window
+    // completely. The --aspiration-growth flag only takes growths of at least 2.
+    int aspiration = 30;
+    int aspiration_growth = 4;
+    static constexpr int kMaxAspiration = 1000;
+    // Late quiet moves of nodes at least three plies from the horizon are searched one or two plies shallower
+    // first and only re-searched at full depth when they beat the bound.
+    bool lmr = true;
+    // One and two plies from the horizon, outside the principal variation: quiet moves whose static score
+    // stays futility_margin per ply short of the bound are skipped, and a node whose static score stays
+    // razor_margin per ply short is scored statically.
+    bool futility = true;
+    bool razoring = true;
+    int futility_margin = 80;
+    int razor_margin = 150;
+    // Leaves where the side to move has to capture are searched on until the captures are over.
+    bool quiescence = true;
+    // Telemetry builds only: an info line on stderr every info_ms while searching, 0 for none, and per search
+    // one line of counters appended to telemetry_path and its spans to trace_path, when they are set.
+    int info_ms = 0;
+    std::string telemetry_path;
+    std::string trace_path;
+
+    // Sets a limit by its protocol name, returns false for unknown names.
+    bool Set(const std::string &name, long long value) {
+        if (name == "depth") {
+            max_depth = int(value);
+        } else if (name == "time") {
+            SetBudget(int(value));
+        } else if (name == "nodes") {
+            max_nodes = uint64_t(value);
+        } else if (name == "threads") {
+            threads = int(value);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    void SetSelective(bool enabled) {
+        lmr = enabled;
+        futility = enabled;
+        razoring = enabled;
+        quiescence = enabled;
+    }
+
+    void SetBudget(int milliseconds) {
+        soft_ms = milliseconds / 2;
+        hard_ms = milliseconds;
+    }
+};
+
+class MoveKey {
+public:
+    int from;
+    int to;
+
+    MoveKey() : from(-1), to(-1) {
+    }
+
+    explicit MoveKey(const Move &move) : from(move.from), to(move.final_square) {
+    }
+
+    bool Matches(const Move &move) const {
+        return from == move.from && to == move.final_square;
+    }
+};
+
+// Move ordering state that outlives one search. Killers are indexed by ply from the root of the search.
+class OrderingTables {
+public:
+    static constexpr int kMaxPly = 128;
+
+    MoveKey killers[kMaxPly][2];
+    int history[2][32][32] = {};
+
+    // Prepares the tables for a search whose root is plies further into the game: killers move up by that
+    // many plies and history is halved, so fresh cutoffs soon outweigh old ones.
+    void Advance(int plies) {
+        std::copy(&killers[plies][0], &killers[0][0] + kMaxPly * 2, &killers[0][0]);
+        std::fill(&killers[kMaxPly - plies][0], &killers[0][0] + kMaxPly * 2, MoveKey());
+        for (auto &side: history) {
+            for (auto &row: side) {
+                for (int &value: row) {
+                    value /= 2;
+                }
+            }
+        }
+    }
+};
+
+class SearchIteration {
+public:
+    int depth;
+    int score;
+    uint64_t nodes;
+    int64_t ms;
+};
+
+class SelectiveStats {
+public:
+    uint64_t reductions = 0;
+    uint64_t researches = 0;
+    uint64_t futility = 0;
+    uint64_t razoring = 0;
+    uint64_t quiescence = 0;
+};
+
+class RootResult {
+public:
+    int score;
+    int move_index;
+    std::vector<MoveKey> line;
+};
+
+class SearchResult {
+public:
+    int move_index = 0;
+    int score = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+    std::vector<MoveKey> pv;
+    std::vector<SearchIteration> iterations;
+    SelectiveStats selective;
+    // Summed over all threads of the search.
+    TableCounters table_counters;
+    Telemetry telemetry;
+};
+
+class Search {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int kMaxPly = OrderingTables::kMaxPly;
+    static constexpr int kPvMoveKey = 1 << 30;
+    static constexpr int kHashMoveKey = 1 << 29;
+    static constexpr int kCaptureKey = 1 << 28;
+    static constexpr int kKillerKey = 1 << 27;
+    // Scores at least this far from zero are wins found by the search or in the tablebase, whose distances are
+    // stored in a byte.
+    static constexpr int kWinBound = Evaluation::kWin - kMaxPly - 256;
+
+    Board board;
+    SearchLimits limits;
+    Clock::time_point start;
+    Clock::time_point hard_deadline;
+    bool stopped;
+    bool follow_pv;
+    uint64_t nodes;
+    uint64_t aspiration_failures;
+    SelectiveStats selective;
+    TableCounters table_counters;
+    // Lazy SMP helpers search one ply deeper on odd ids and stop when the main thread raises abort.
+    int helper_id;
+    const std::atomic<bool> *abort;
+    MoveKey pv[kMaxPly][kMaxPly];
+    int pv_length[kMaxPly];
+    std::vector<MoveKey> previous_pv;
+    OrderingTables ordering;
+    Telemetry telemetry;
+    Clock::time_point next_info;
+
+    Search(const Board &root, const SearchLimits &new_limits) : board(root),
+                                                               limits(new_limits),
+                                                               stopped(false),
+                                                               follow_pv(false),
+                                                               nodes(0),
+                                                               aspiration_failures(0),
+                                                               helper_id(0),
+                                                               abort(nullptr) {
+        if (root.ordering) {
+            ordering = *root.ordering;
+        }
+    }
+
+    int64_t ElapsedMs() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    }
+
+    // Every move is scored once: the PV move, then the hash move, then captures by size, then the killers of
+    // the ply, then the history of the side to move.
+    void ScoreMoves(const MoveList &moves, int *keys, int ply, Side side, const TableEntry *hash,
+                    const MoveKey *pv_move) const {
+        const int(&side_history)[32][32] = ordering.history[side == Side::Bot ? 0 : 1];
+        for (size_t i = 0; i < moves.size(); ++i) {
+            const Move &move = moves.moves[i];
+            if (pv_move && pv_move->Matches(move)) {
+                keys[i] = kPvMoveKey;
+            } else if (hash && hash->from == move.from && hash->to == move.final_square) {
+                keys[i] = kHashMoveKey;
+            } else if (move.eaten) {
+                keys[i] = kCaptureKey + PopCount(move.eaten) * 4 + PopCount(move.eaten & board.position.kings);
+            } else if (ordering.killers[ply][0].Matches(move)) {
+                keys[i] = kKillerKey + 1;
+            } else if (ordering.killers[ply][1].Matches(move)) {
+                keys[i] = kKillerKey;
+            } else {
+                keys[i] = side_history[move.from][move.final_square];
+            }
+        }
+    }
+
+    // Selection step: moves the best scored of the remaining moves to index, so lists cut off early are
+    // never fully sorted.
+    static Move &PickNext(MoveList &moves, int *keys, size_t index) {
+        size_t best = index;
+        for (size_t i = index + 1; i < moves.size(); ++i) {
+            if (keys[i] > keys[best]) {
+                best = i;
+            }
+        }
+        std::swap(moves[index], moves[best]);
+        std::swap(keys[index], keys[best]);
+        return moves[index];
+    }
+
+    // Quiet moves that cut off become killers of the ply and earn history for their side.
+    void RecordCutoff(const Move &move, int ply, int depth, Side side) {
+        if (move.eaten) {
+            return;
+        }
+        MoveKey(&ply_killers)[2] = ordering.killers[ply];
+        if (!ply_killers[0].Matches(move)) {
+            ply_killers[1] = ply_killers[0];
+            ply_killers[0] = MoveKey(move);
+        }
+        int(&side_history)[32][32] = ordering.history[side == Side::Bot ? 0 : 1];
+        side_history[move.from][move.final_square] += depth * depth;
+        if (side_history[move.from][move.final_square] >= kKillerKey) {
+            for (auto &row: side_history) {
+                for (int &value: row) {
+                    value /= 2;
+                }
+            }
+        }
+    }
+
+    void UpdatePv(int ply, const Move &move) {
+        pv[ply][0] = MoveKey(move);
+        std::copy(pv[ply + 1], pv[ply + 1] + pv_length[ply + 1], pv[ply] + 1);
+        pv_length[ply] = pv_length[ply + 1] + 1;
+    }
+
+    // Iterative deepening over the root moves of side. Returns the result of the last completed depth,
+    // moves are searched in the order of the previous iteration with its best move first. Without moves there is
+    // nothing to search and the result has move_index -1.
+    SearchResult Run(MoveList &moves, Side side) {
+        if (moves.empty()) {
+            SearchResult result;
+            result.move_index = -1;
+            return result;
+        }
+        start = Clock::now();
+        hard_deadline = start + std::chrono::milliseconds(limits.hard_ms);
+        next_info = start + std::chrono::milliseconds(limits.info_ms);
+        Telemetry *outer = Telemetry::Current();
+        if (Telemetry::kEnabled) {
+            // A span per depth and root move, reserved before counting starts so spans allocate nothing later.
+            telemetry.spans.reserve(size_t(kMaxPly) * (moves.size() + 1) + 1);
+        }
+        Telemetry::Current() = Telemetry::kEnabled ? &telemetry : nullptr;
+        std::vector<int> order(moves.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = int(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int lhs, int rhs) {
+            return PopCount(moves[lhs].eaten) > PopCount(moves[rhs].eaten);
+        });
+
+        SearchResult result;
+        for (int depth = 1 + helper_id % 2; depth <= std::min(limits.max_depth, kMaxPly - 2); ++depth) {
+            int alpha = std::numeric_limits<int>::min();
+            int beta = std::numeric_limits<int>::max();
+            int64_t delta = limits.aspiration;
+            if (delta && !result.iterations.empty()) {
+                alpha = result.score - int(delta);
+                beta = result.score + int(delta);
+            }
+            TELEMETRY_SPAN("depth", depth, helper_id);
+            RootResult root;
+            while (true) {
+                root = SearchRoot(moves, order, alpha, beta, depth, side);
+                if (stopped) {
+                    break;
+                }
+                bool fail_low = alpha != std::numeric_limits<int>::min() && root.score <= alpha;
+                bool fail_high = beta != std::numeric_limits<int>::max() && root.score >= beta;
+                if (!fail_low && !fail_high) {
+                    break;
+                }
+                ++aspiration_failures;
+                int64_t grown = delta * limits.aspiration_growth;
+                bool open = grown <= delta || grown > SearchLimits::kMaxAspiration;
+                delta = grown;
+                if (fail_low) {
+                    alpha = open ? std::numeric_limits<int>::min() : result.score - int(delta);
+                } else {
+                    beta = open ? std::numeric_limits<int>::max() : result.score + int(delta);
+                }
+            }
+            if (stopped) {
+                break;
+            }
+
+            result.move_index = root.move_index;
+            result.score = root.score;
+            result.depth = depth;
+            telemetry.depth = depth;
+            result.pv = root.line;
+            result.iterations.push_back({depth, root.score, nodes, ElapsedMs()});
+            if (helper_id == 0 && limits.on_iteration) {
+                limits.on_iteration(result);
+            }
+            previous_pv = root.line;
+            std::rotate(order.begin(), std::find(order.begin(), order.end(), root.move_index),
+                        std::find(order.begin(), order.end(), root.move_index) + 1);
+            if (ElapsedMs() >= limits.soft_ms) {
+                break;
+            }
+        }
+        result.nodes = nodes;
+        result.selective = selective;
+        result.table_counters = table_counters;
+        telemetry.nodes = nodes;
+        telemetry.depth = result.depth;
+        telemetry.ms = ElapsedMs();
+        if (Telemetry::kEnabled) {
+            int64_t start_us = Telemetry::Microseconds(start);
+            telemetry.spans.push_back(
+                    {"search", helper_id, start_us, Telemetry::Microseconds(Clock::now()) - start_us, helper_id});
+        }
+        Telemetry::Current() = outer;
+        result.telemetry = telemetry;
+        // Searches with helpers are written by ParallelSearch once the helpers' counters are merged.
+        if (helper_id == 0 && limits.threads <= 1) {
+            telemetry.Write(limits.telemetry_path, limits.trace_path);
+        }
+        return result;
+    }
+
+    // One pass over the root moves in order inside the window. The first move gets the window, every later one a
+    // null window at the best score so far and a re-search only if it beats it.
+    RootResult SearchRoot(MoveList &moves, const std::vector<int> &order, int alpha, int beta, int depth, Side side) {
+        bool maximize = side == Side::Bot;
+        RootResult root = {maximize ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max(),
+                           order.empty() ? -1 : order[0], {}};
+        for (size_t i = 0; i < order.size(); ++i) {
+            Move &move = moves[order[i]];
+            TELEMETRY_SPAN("root move", order[i], helper_id);
+            follow_pv = i == 0 && !previous_pv.empty();
+            int score;
+            if (i == 0 || !limits.pvs) {
+                score = MinMaxAI(move, alpha, beta, depth, 1, side);
+            } else if (maximize) {
+                score = MinMaxAI(move, alpha, alpha + 1, depth, 1, side);
+                if (!stopped && score > alpha && score < beta) {
+                    score = MinMaxAI(move, alpha, beta, depth, 1, side);
+                }
+            } else {
+                score = MinMaxAI(move, beta - 1, beta, depth, 1, side);
+                if (!stopped && score < beta && score > alpha) {
+                    score = MinMaxAI(move, alpha, beta, depth, 1, side);
+                }
+            }
+            if (stopped) {
+                break;
+            }
+            if (maximize ? score > root.score : score < root.score) {
+                root.score = score;
+                root.move_index = order[i];
+                root.line.assign(1, MoveKey(move));
+                root.line.insert(root.line.end(), pv[1], pv[1] + pv_length[1]);
+            }
+            if (maximize) {
+                alpha = std::max(alpha, score);
+            } else {
+                beta = std::min(beta, score);
+            }
+            if (alpha >= beta) {
+                break;
+            }
+        }
+        return root;
+    }
+
+    // Plies a late move is reduced by, 0 for moves that have to be searched at full depth.
+    int Reduction(const Move &move, int key, size_t index, int depth) const {
+        if (!limits.lmr || depth < 3 || index < 3 || move.eaten || move.promotion || key >= kKillerKey) {
+            return 0;
+        }
+        return index >= 6 ? 2 : 1;
+    }
+
+    // Searches a move after the first one of a node: a null window at the bound the mover has to beat (the
+    // full window without PVS) at the reduced depth, then at full depth if a reduced search beats the bound, then
+    // with the full window if the score lies inside it.
+    int SearchLater(Move &move, int alpha, int beta, int depth, int ply, Side side, int reduction) {
+        bool maximize = side == Side::Bot;
+        int scout_alpha = limits.pvs ? (maximize ? alpha : beta - 1) : alpha;
+        int scout_beta = limits.pvs ? scout_alpha + 1 : beta;
+        if (reduction) {
+            ++selective.reductions;
+        }
+        int score = MinMaxAI(move, scout_alpha, scout_beta, depth - reduction, ply, side);
+        if (!stopped && reduction && (maximize ? score > alpha : score < beta)) {
+            ++selective.researches;
+            score = MinMaxAI(move, scout_alpha, scout_beta, depth, ply, side);
+        }
+        if (!stopped && limits.pvs && score > alpha && score < beta) {
+            score = MinMaxAI(move, alpha, beta, depth, ply, side);
+        }
+        return score;
+    }
+
+    // Win scores count plies from the root while the table counts them from the entry's own position, so an
+    // entry reached at another ply still gives the right distance.
+    static int ToTableScore(int score, int ply) {
+        return score >= kWinBound ? score + ply : score <= -kWinBound ? score - ply : score;
+    }
+
+    static int FromTableScore(int score, int ply) {
+        return score >= kWinBound ? score - ply : score <= -kWinBound ? score + ply : score;
+    }
+
+    void ReportProgress() {
+        telemetry.nodes = nodes;
+        telemetry.ms = ElapsedMs();
+        std::cerr << telemetry.Info() << "\n";
+        next_info = Clock::now() + std::chrono::milliseconds(limits.info_ms);
+    }
+
+    // Scores the position after curr_move made by side. The move is made and unmade on the board in place.
+    int MinMaxAI(Move &curr_move, int alpha, int beta, int depth, int ply, Side side) {
+        bool on_pv = follow_pv;
+        follow_pv = false;
+        pv_length[ply] = 0;
+        ++nodes;
+        if ((limits.max_nodes && nodes >= limits.max_nodes)
+            || ((nodes & 1023) == 0
+                && (Clock::now() >= hard_deadline || (abort && abort->load(std::memory_order_relaxed))))) {
+            stopped = true;
+        }
+        if (stopped) {
+            return 0;
+        }
+        if (Telemetry::kEnabled) {
+            telemetry.max_ply = std::max(telemetry.max_ply, ply);
+            if ((nodes & 1023) == 0 && limits.info_ms && helper_id == 0 && Clock::now() >= next_info) {
+                ReportProgress();
+            }
+        }
+        uint8_t value;
+        if (depth <= 0 || ply >= kMaxPly - 2 || board.position.Pieces(side) == 0) {
+            Position after = board.PositionAfter(curr_move);
+            if (board.tablebase && board.tablebase->Probe(after, Opponent(side), &value)) {
+                return Tablebase::Score(value, Opponent(side), ply);
+            }
+            if (!limits.quiescence || ply >= kMaxPly - 2 || !after.Jumpers(Opponent(side))) {
+                return Board::SimulateMoveAndScore(board, curr_move);
+            }
+            ++selective.quiescence;
+        }
+        auto undo = board.ImplementMove(&curr_move);
+        if (board.tablebase && board.tablebase->Probe(board.position, Opponent(side), &value)) {
+            board.UndoMove(curr_move, undo);
+            return Tablebase::Score(value, Opponent(side), ply);
+        }
+
+        uint64_t key = board.Key(Opponent(side));
+        TableEntry entry;
+        bool found = board.table && board.table->Probe(key, &entry, &table_counters);
+        if (found) {
+            entry.score = FromTableScore(entry.score, ply);
+        }
+        TELEMETRY_COUNT(tt_probes += board.table != nullptr);
+        TELEMETRY_COUNT(tt_hits += found);
+        if (found && entry.depth >= depth
+            && (entry.bound == Bound::Exact
+                || (entry.bound == Bound::Lower && entry.score >= beta)
+                || (entry.bound == Bound::Upper && entry.score <= alpha))) {
+            board.UndoMove(curr_move, undo);
+            return entry.score;
+        }
+
+        auto moves = board.CurrentMoves(Opponent(side));
+        if (moves.empty()) {
+            board.UndoMove(curr_move, undo);
+            return side == Side::Bot ? Evaluation::kWin - ply : ply - Evaluation::kWin;
+        }
+
+        bool pv_node = int64_t(beta) - alpha > 1;
+        bool frontier = depth >= 1 && depth <= 2 && !pv_node && !moves[0].eaten;
+        if (frontier && limits.razoring) {
+            int static_score = board.Score(Opponent(side));
+            if (side == Side::User ? static_score + limits.razor_margin * depth <= alpha
+                                   : static_score - limits.razor_margin * depth >= beta) {
+                ++selective.razoring;
+                board.UndoMove(curr_move, undo);
+                return static_score;
+            }
+        }
+
+        int keys[MoveList::kCapacity];
+        const MoveKey *pv_move = on_pv && ply < int(previous_pv.size()) ? &previous_pv[ply] : nullptr;
+        ScoreMoves(moves, keys, ply, Opponent(side), found ? &entry : nullptr, pv_move);
+
+        int alpha_orig = alpha;
+        int beta_orig = beta;
+        int best_score;
+        Move *best_move = nullptr;
+        if (side == Side::User) {
+            best_score = std::numeric_limits<int>::min();
+            for (size_t i = 0; i < moves.size(); ++i) {
+                Move &move = PickNext(moves, keys, i);
+                if (frontier && limits.futility && i > 0 && !move.promotion) {
+                    int estimate = Board::SimulateMoveAndScore(board, move) + limits.futility_margin * depth;
+                    if (estimate <= alpha) {
+                        ++selective.futility;
+                        best_score = std::max(best_score, estimate);
+                        continue;
+                    }
+                }
+                follow_pv = pv_move && pv_move->Matches(move);
+                int curr_score;
+                if (i == 0 || depth <= 1) {
+                    curr_score = MinMaxAI(move, alpha, beta, depth - 1, ply + 1, Side::Bot);
+                } else {
+                    curr_score = SearchLater(move, alpha, beta, depth - 1, ply + 1, Side::Bot,
+                                             Reduction(move, keys[i], i, depth));
+                }
+                if (stopped) {
+                    break;
+                }
+                if (curr_score > best_score) {
+                    best_score = curr_score;
+                    best_move = &move;
+                    UpdatePv(ply, move);
+                }
+                alpha = std::max(alpha, curr_score);
+                if (beta <= alpha) {
+                    TELEMETRY_COUNT(cutoffs[std::min<size_t>(i, Telemetry::kCutoffSlots - 1)]++);
+                    RecordCutoff(move, ply, depth, Side::Bot);
+                    break;
+                }
+            }
+        } else {
+            best_score = std::numeric_limits<int>::max();
+            for (size_t i = 0; i < moves.size(); ++i) {
+                Move &move = PickNext(moves, keys, i);
+                if (frontier && limits.futility && i > 0 && !move.promotion) {
+                    int estimate = Board::SimulateMoveAndScore(board, move) - limits.futility_margin * depth;
+                    if (estimate >= beta) {
+                        ++selective.futility;
+                        best_score = std::min(best_score, estimate);
+                        continue;
+                    }
+                }
+                follow_pv = pv_move && pv_move->Matches(move);
+                int curr_score;
+                if (i == 0 || depth <= 1) {
+                    curr_score = MinMaxAI(move, alpha, beta, depth - 1, ply + 1, Side::User);
+                } else {
+                    curr_score = SearchLater(move, alpha, beta, depth - 1, ply + 1, Side::User,
+                                             Reduction(move, keys[i], i, depth));
+                }
+                if (stopped) {
+                    break;
+                }
+                if (curr_score < best_score) {
+                    best_score = curr_score;
+                    best_move = &move;
+                    UpdatePv(ply, move);
+                }
+                beta = std::min(beta, curr_score);
+                if (beta <= alpha) {
+                    TELEMETRY_COUNT(cutoffs[std::min<size_t>(i, Telemetry::kCutoffSlots - 1)]++);
+                    RecordCutoff(move, ply, depth, Side::User);
+                    break;
+                }
+            }
+        }
+        board.UndoMove(curr_move, undo);
+        if (stopped) {
+            return 0;
+        }
+
+        if (board.table) {
+            entry.score = ToTableScore(best_score, ply);
+            entry.depth = std::max(depth, 0);
+            entry.bound = best_score <= alpha_orig ? Bound::Upper
+                                                   : best_score >= beta_orig ? Bound::Lower : Bound::Exact;
+            entry.from = best_move->from;
+            entry.to = best_move->final_square;
+            board.table->Store(key, entry, &table_counters);
+        }
+        return best_score;
+    }
+};
+
+// Lazy SMP: helper threads run the same iterative deepening on their own boards and only share the
+// transposition table with the main search, whose result is returned. One thread is the plain search.
+// A root with ordering tables starts every search from them and gets the main search's tables back, advanced
+// to the position two plies later where the same side moves next.
+inline SearchResult ParallelSearch(const Board &root, MoveList &moves, const SearchLimits &limits, Side side) {
+    std::atomic<bool> abort(false);
+    std::vector<std::unique_ptr<Search>> helpers;
+    std::vector<MoveList> helper_moves(std::max(limits.threads - 1, 0), moves);
+    std::vector<std::thread> threads;
+    for (int id = 1; id < limits.threads; ++id) {
+        helpers.emplace_back(new Search(root, limits));
+        helpers.back()->helper_id = id;
+        helpers.back()->abort = &abort;
+        threads.emplace_back([helper = helpers.back().get(), helper_moves = &helper_moves[id - 1], side]() {
+            helper->Run(*helper_moves, side);
+        });
+    }
+
+    std::unique_ptr<Search> main_search(new Search(root, limits));
+    main_search->abort = limits.stop;
+    auto result = main_search->Run(moves, side);
+    abort = true;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+        result.nodes += helpers[i]->nodes;
+        result.table_counters += helpers[i]->table_counters;
+        result.telemetry.Merge(helpers[i]->telemetry);
+    }
+    if (limits.threads > 1) {
+        result.telemetry.nodes = result.nodes;
+        result.telemetry.Write(limits.telemetry_path, limits.trace_path);
+    }
+    if (root.ordering) {
+        *root.ordering = main_search->ordering;
+        root.ordering->Advance(2);
+    }
+    return result;
+}
+
+// Plays random moves from the start position with a fixed seed, so the same arguments give the same board.
+// Stops early when the side to move has no moves; to_move gets the side to move in the returned board.
+inline Board RandomPosition(unsigned seed, int plies, Side *to_move = nullptr) {
+    Board board;
+    std::mt19937 generator(seed);
+    Side side = Side::User;
+    for (int ply = 0; ply < plies; ++ply) {
+        auto moves = board.CurrentMoves(side);
+        if (moves.empty()) {
+            break;
+        }
+        board.ImplementMove(&moves[generator() % moves.size()]);
+        side = Opponent(side);
+    }
+    if (to_move) {
+        *to_move = side;
+    }
+    return board;
+}
+
+// Fixed-depth searches of a few bot-to-move positions with 1, 2, 4, ... threads, each on an empty table.
+inline void ReportSpeedup(int max_threads, int depth, size_t hash_megabytes,
+                          const std::shared_ptr<const Network> &network) {
+    std::vector<Board> positions = {RandomPosition(1, 1), RandomPosition(2, 9), RandomPosition(3, 17)};
+    auto table = std::make_shared<TranspositionTable>(hash_megabytes);
+    SearchLimits limits;
+    limits.max_depth = depth;
+    limits.soft_ms = std::numeric_limits<int>::max();
+    limits.hard_ms = std::numeric_limits<int>::max();
+
+    double single_thread_ms = 0;
+    std::cout << "threads,time_ms,nodes,nps,speedup\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        limits.threads = threads;
+        uint64_t nodes = 0;
+        auto start = Search::Clock::now();
+        for (Board board: positions) {
+            table->Clear();
+            board.table = table;
+            board.SetNetwork(network);
+            auto moves = board.CurrentMoves(Side::Bot);
+            if (!moves.empty()) {
+                nodes += ParallelSearch(board, moves, limits, Side::Bot).nodes;
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(Search::Clock::now() - start).count();
+        if (threads == 1) {
+            single_thread_ms = ms;
+        }
+        std::cout << threads << "," << int64_t(ms) << "," << nodes << "," << uint64_t(nodes / (ms / 1000 + 1e-9))
+                  << "," << single_thread_ms / ms << "\n";
+    }
+}
+
+inline bool DistributedSearch(ClusterCoordinator &cluster, const Board &root, MoveList &moves,
+                              const SearchLimits &limits, Side side, SearchResult *result);
+
+inline bool Board::BotMove(const SearchLimits &limits, SearchResult *searched, const SearchResult *pondered,
+                           ClusterCoordinator *cluster) {
+    auto moves = CurrentMoves(Side::Bot);
+
+    if (moves.empty()) {
+        return false;
+    }
+
+    std::cout << "Possible moves:\n";
+    for (Move &move: moves) {
+        PrintMove("From ", move);
+    }
+
+    Move *chosen_move = &moves[0];
+    uint8_t value = 0;
+    const OpeningBook::Entry *entry = nullptr;
+    int from_book = book ? book->BestMove(*this, moves, &entry) : -1;
+    int decided = tablebase && from_book < 0 ? tablebase->BestMove(*this, moves, Side::Bot) : -1;
+    if (from_book >= 0) {
+        chosen_move = &moves[from_book];
+        std::cout << "Book move, depth " << int(entry->depth) << ", score " << entry->score << "\n";
+    } else if (decided >= 0) {
+        chosen_move = &moves[decided];
+        tablebase->Probe(position, Side::Bot, &value);
+        std::cout << "Tablebase: " << (value % 2 ? "loss" : "win") << " in " << value - 1 << " plies\n";
+    } else if (pondered && moves.size() != 1) {
+        chosen_move = &moves[pondered->move_index];
+        if (searched) {
+            *searched = *pondered;
+        }
+        std::cout << "Ponder hit: depth " << pondered->depth << ", score " << pondered->score << ", "
+                  << pondered->nodes << " nodes\n";
+    } else if (moves.size() != 1) {
+        auto start = Search::Clock::now();
+        SearchResult result;
+        if (!cluster || !DistributedSearch(*cluster, *this, moves, limits, Side::Bot, &result)) {
+            result = ParallelSearch(*this, moves, limits, Side::Bot);
+        }
+        chosen_move = &moves[result.move_index];
+        if (searched) {
+            *searched = result;
+        }
+        std::cout << "Depth " << result.depth << ", score " << result.score << ", " << result.nodes << " nodes in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(Search::Clock::now() - start).count()
+                  << " ms\n";
+        if (table) {
+            std::cout << "Hash table: " << result.table_counters.hits << " hits, " << result.table_counters.misses
+                      << " misses, " << result.table_counters.overwrites << " overwrites\n";
+        }
+    }
+
+    PrintMove("Made ", *chosen_move);
+    PrintEaten(*chosen_move);
+
+    ImplementMove(chosen_move);
+    return true;
+}
+
+//~~~~
+
+//~~~~ bench.h
+
+class BenchPosition {
+public:
+    const char *name;
+    const char *squares;
+    Side side;
+};
+
+inline const std::vector<BenchPosition> &BenchSuite() {
+    static const std::vector<BenchPosition> suite = {
+            {"start", "bbbbbbbbbbbb........uuuuuuuuuuuu", Side::User},
+            {"opening", "bbbbb..bb.bb......u.u..uuu.uu.uu", Side::Bot},
+            {"early", "bbb.bbbb...bbu.u...b.uu.u.uuu.uu", Side::User},
+            {"middle", "b.bb..b...bbub.u..b...uuuuuu...u", Side::Bot},
+            {"late-middle", ".b.bb.b..bb.b....bu....uu..b.uu.", Side::User},
+            {"crowned", "........b....U.....bub.bu..uu.uu", Side::User},
+            {"kings", "..B......bb..U...bb...b...U.....", Side::Bot},
+            {"endgame", "................b.....u.....B..u", Side::User},
+    };
+    return suite;
+}
+
+// Searches one suite position single-threaded on a cleared table.
+inline SearchResult BenchSearch(const BenchPosition &entry, const SearchLimits &limits,
+                                const std::shared_ptr<TranspositionTable> &table, const std::shared_ptr<const Network> &network, MoveList *moves,
+                                int64_t *ms) {
+    Board board = Board::FromString(entry.squares);
+    table->Clear();
+    board.table = table;
+    board.SetNetwork(network);
+    *moves = board.CurrentMoves(entry.side);
+    Search search(board, limits);
+    auto result = search.Run(*moves, entry.side);
+    *ms = search.ElapsedMs();
+    return result;
+}
+
+inline SearchLimits BenchLimits(SearchLimits limits, int depth, uint64_t max_nodes) {
+    limits.threads = 1;
+    limits.max_depth = depth;
+    limits.max_nodes = max_nodes;
+    limits.soft_ms = std::numeric_limits<int>::max();
+    limits.hard_ms = std::numeric_limits<int>::max();
+    return limits;
+}
+
+// Searches every suite position single-threaded on a cleared table and prints one JSON object with the
+// per-position and total numbers. The checksum covers the best moves, so it only changes when the search does.
+inline void RunBench(const SearchLimits &search_limits, int depth, uint64_t max_nodes, size_t hash_megabytes,
+                     const std::shared_ptr<const Network> &network) {
+    auto table = std::make_shared<TranspositionTable>(hash_megabytes);
+    SearchLimits limits = BenchLimits(search_limits, depth, max_nodes);
+
+    uint64_t total_nodes = 0;
+    int64_t total_ms = 0;
+    uint64_t checksum = 14695981039346656037ull;
+    std::cout << "{\"depth\":" << depth << ",\"max_nodes\":" << max_nodes << ",\"positions\":[";
+    for (size_t i = 0; i < BenchSuite().size(); ++i) {
+        const BenchPosition &entry = BenchSuite()[i];
+        MoveList moves;
+        int64_t ms;
+        auto result = BenchSearch(entry, limits, table, network, &moves, &ms);
+        total_nodes += result.nodes;
+        total_ms += ms;
+
+        const Move &best = moves[result.move_index];
+        for (uint64_t value: {uint64_t(best.from), uint64_t(best.final_square), uint64_t(uint32_t(result.score))}) {
+            checksum = (checksum ^ value) * 1099511628211ull;
+        }
+
+        double ebf = 0;
+        size_t count = result.iterations.size();
+        if (count >= 3) {
+            uint64_t last = result.iterations[count - 1].nodes - result.iterations[count - 2].nodes;
+            uint64_t previous = result.iterations[count - 2].nodes - result.iterations[count - 3].nodes;
+            ebf = previous ? double(last) / double(previous) : 0;
+        }
+
+        std::cout << (i ? "," : "") << "{\"name\":\"" << entry.name << "\",\"depth\":" << result.depth
+                  << ",\"score\":" << result.score << ",\"best\":[" << int(best.from) << ","
+                  << int(best.final_square) << "],\"nodes\":" << result.nodes << ",\"ms\":" << ms
+                  << ",\"nps\":" << uint64_t(result.nodes * 1000 / std::max<int64_t>(ms, 1))
+                  << ",\"ebf\":" << ebf << ",\"time_to_depth_ms\":[";
+        for (size_t j = 0; j < count; ++j) {
+            std::cout << (j ? "," : "") << result.iterations[j].ms;
+        }
+        std::cout << "]}";
+    }
+    std::cout << "],\"total_nodes\":" << total_nodes << ",\"total_ms\":" << total_ms
+              << ",\"nps\":" << uint64_t(total_nodes * 1000 / std::max<int64_t>(total_ms, 1))
+              << ",\"checksum\":\"" << std::hex << checksum << std::dec << "\"}\n";
+}
+
+// Searches the suite with plain alpha-beta and full root windows, then with the given PVS and aspiration
+// settings, and prints the nodes each needs and whether the best move and score agree.
+inline void ComparePvs(const SearchLimits &search_limits, int depth, uint64_t max_nodes, size_t hash_megabytes,
+                       const std::shared_ptr<const Network> &network) {
+    auto table = std::make_shared<TranspositionTable>(hash_megabytes);
+    SearchLimits limits = BenchLimits(search_limits, depth, max_nodes);
+    SearchLimits plain = limits;
+    plain.pvs = false;
+    plain.aspiration = 0;
+
+    uint64_t total_plain = 0;
+    uint64_t total_pvs = 0;
+    std::cout << "position,plain_nodes,pvs_nodes,saved_percent,same_move,same_score\n";
+    for (const BenchPosition &entry: BenchSuite()) {
+        MoveList plain_moves;
+        MoveList moves;
+        int64_t ms;
+        auto plain_result = BenchSearch(entry, plain, table, network, &plain_moves, &ms);
+        auto result = BenchSearch(entry, limits, table, network, &moves, &ms);
+        total_plain += plain_result.nodes;
+        total_pvs += result.nodes;
+        std::cout << entry.name << "," << plain_result.nodes << "," << result.nodes << ","
+                  << 100.0 * (1 - double(result.nodes) / std::max<uint64_t>(plain_result.nodes, 1)) << ","
+                  << (plain_result.move_index == result.move_index) << "," << (plain_result.score == result.score)
+                  << "\n";
+    }
+    std::cout << "total," << total_plain << "," << total_pvs << ","
+              << 100.0 * (1 - double(total_pvs) / std::max<uint64_t>(total_plain, 1)) << ",,\n";
+}
+
+// Searches the suite with every selective technique off, with each one alone and with all of them, and prints
+// the nodes and time of each configuration, how many best moves agree with the full-width search and the
+// counters of the techniques.
+inline void CompareSelective(const SearchLimits &search_limits, int depth, uint64_t max_nodes, size_t hash_megabytes,
+                             const std::shared_ptr<const Network> &network) {
+    auto table = std::make_shared<TranspositionTable>(hash_megabytes);
+    SearchLimits none = BenchLimits(search_limits, depth, max_nodes);
+    none.SetSelective(false);
+    std::vector<std::pair<std::string, SearchLimits>> configurations = {{"none", none}};
+    for (const char *name: {"lmr", "futility", "razoring", "quiescence", "all"}) {
+        SearchLimits limits = none;
+        std::string technique = name;
+        limits.lmr = technique == "lmr" || technique == "all";
+        limits.futility = technique == "futility" || technique == "all";
+        limits.razoring = technique == "razoring" || technique == "all";
+        limits.quiescence = technique == "quiescence" || technique == "all";
+        configurations.emplace_back(technique, limits);
+    }
+
+    std::vector<int> reference;
+    std::cout << "config,nodes,ms,same_moves,reductions,researches,futility,razoring,quiescence\n";
+    for (const auto &configuration: configurations) {
+        uint64_t nodes = 0;
+        int64_t total_ms = 0;
+        int same_moves = 0;
+        SelectiveStats stats;
+        for (size_t i = 0; i < BenchSuite().size(); ++i) {
+            MoveList moves;
+            int64_t ms;
+            auto result = BenchSearch(BenchSuite()[i], configuration.second, table, network, &moves, &ms);
+            if (reference.size() < BenchSuite().size()) {
+                reference.push_back(result.move_index);
+            }
+            same_moves += reference[i] == result.move_index;
+            nodes += result.nodes;
+            total_ms += ms;
+            stats.reductions += result.selective.reductions;
+            stats.researches += result.selective.researches;
+            stats.futility += result.selective.futility;
+            stats.razoring += result.selective.razoring;
+            stats.quiescence += result.selective.quiescence;
+        }
+        std::cout << configuration.first << "," << nodes << "," << total_ms << "," << same_moves << "/"
+                  << BenchSuite().size() << "," << stats.reductions << "," << stats.researches << ","
+                  << stats.futility << "," << stats.razoring << "," << stats.quiescence << "\n";
+    }
+}
+
+//~~~~
+
+//~~~~ book_builder.h
+
+// Walks every user reply for user_moves moves from the start position. Each bot-to-move position is searched
+// to depth and only the move found is followed, so the book covers every line the bot itself can reach.
+inline void BuildOpeningBook(OpeningBook &book, int user_moves, const SearchLimits &limits, size_t hash_megabytes,
+                             const std::shared_ptr<const Network> &network) {
+    std::vector<Board> frontier(1);
+    frontier[0].table = std::make_shared<TranspositionTable>(hash_megabytes);
+    frontier[0].SetNetwork(network);
+    std::set<uint64_t> seen;
+    for (int move = 0; move < user_moves; ++move) {
+        std::vector<Board> next;
+        for (Board &board: frontier) {
+            auto replies = board.CurrentMoves(Side::User);
+            for (Move &reply: replies) {
+                Board after = board;
+                after.ImplementMove(&reply);
+                auto moves = after.CurrentMoves(Side::Bot);
+                if (moves.empty() || !seen.insert(after.Key(Side::Bot)).second) {
+                    continue;
+                }
+                auto result = ParallelSearch(after, moves, limits, Side::Bot);
+                Move &best = moves[result.move_index];
+                book.Add({after.Key(Side::Bot), result.score, best.from, best.final_square, uint8_t(result.depth), 0});
+                after.ImplementMove(&best);
+                next.push_back(after);
+            }
+        }
+        std::cerr << "Move " << move + 1 << ": " << seen.size() << " positions\n";
+        frontier.swap(next);
+    }
+}
+
+//~~~~
+
+//~~~~ self_play.h
+
+#include <mutex>
+
+class SelfPlayGame {
+public:
+    Side winner = Side::NoOne;
+    int plies = 0;
+    std::string record;
+};
+
+// Plays one game from seeded random opening plies, each side searching single-threaded with its own limits and
+// its own table, so neither side reuses what the other one searched.
+// A game still running after kMaxPlies is a draw. The record is the opening position, the side to move, the
+// moves as from-to squares (x for captures) and the result.
+inline SelfPlayGame PlaySelfPlayGame(unsigned seed, int random_plies, const SearchLimits &bot_limits,
+                                     const SearchLimits &user_limits,
+                                     const std::shared_ptr<TranspositionTable> &bot_table,
+                                     const std::shared_ptr<TranspositionTable> &user_table,
+                                     const std::shared_ptr<const Network> &network) {
+    static constexpr int kMaxPlies = 300;
+    SelfPlayGame game;
+    Side side;
+    Board board = RandomPosition(seed, random_plies, &side);
+    board.SetNetwork(network);
+    bot_table->Clear();
+    user_table->Clear();
+    game.record = board.ToString() + (side == Side::Bot ? " b" : " u");
+    for (; game.plies < kMaxPlies; ++game.plies) {
+        auto moves = board.CurrentMoves(side);
+        if (moves.empty()) {
+            game.winner = Opponent(side);
+            break;
+        }
+        int index = 0;
+        if (moves.size() != 1) {
+            board.table = side == Side::Bot ? bot_table : user_table;
+            std::unique_ptr<Search> search(new Search(board, side == Side::Bot ? bot_limits : user_limits));
+            index = search->Run(moves, side).move_index;
+        }
+        Move &move = moves[index];
+        game.record += " " + Board::MoveText(move);
+        board.ImplementMove(&move);
+        side = Opponent(side);
+    }
+    game.record += game.winner == Side::Bot ? " bot\n" : game.winner == Side::User ? " user\n" : " draw\n";
+    return game;
+}
+
+// Plays games on a pool of workers that take the next game number until all are played. The first limits play
+// the bot in even games and the user in odd ones, so both sides of every opening seed are covered. Records
+// are appended to path as games finish; results are counted from the point of view of the first limits.
+// hash_megabytes is the budget of the whole run, split evenly over the two tables of every worker.
+inline bool RunSelfPlay(int games, int workers, int random_plies, const SearchLimits &first,
+                        const SearchLimits &second, size_t hash_megabytes, const std::string &path,
+                        const std::shared_ptr<const Network> &network) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    std::mutex out_mutex;
+    std::atomic<int> next_game(0);
+    std::atomic<int> wins(0);
+    std::atomic<int> draws(0);
+    std::atomic<int> losses(0);
+    std::atomic<uint64_t> plies(0);
+    auto start = Search::Clock::now();
+    size_t table_megabytes = std::max<size_t>(hash_megabytes / (2 * size_t(std::max(workers, 1))), 1);
+
+    std::vector<std::thread> threads;
+    for (int id = 0; id < std::max(workers, 1); ++id) {
+        threads.emplace_back([&]() {
+            auto bot_table = std::make_shared<TranspositionTable>(table_megabytes);
+            auto user_table = std::make_shared<TranspositionTable>(table_megabytes);
+            for (int number = next_game++; number < games; number = next_game++) {
+                bool first_is_bot = number % 2 == 0;
+                auto game = PlaySelfPlayGame(unsigned(number / 2), random_plies, first_is_bot ? first : second,
+                                             first_is_bot ? second : first, bot_table, user_table, network);
+                if (game.winner == Side::NoOne) {
+                    ++draws;
+                } else {
+                    ++((game.winner == Side::Bot) == first_is_bot ? wins : losses);
+                }
+                plies += game.plies;
+                std::lock_guard<std::mutex> lock(out_mutex);
+                out << number << " " << game.record;
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(Search::Clock::now() - start).count();
+    std::cout << "games,workers,ms,games_per_s,wins,draws,losses,avg_plies\n"
+              << games << "," << workers << "," << int64_t(ms) << "," << games / (ms / 1000 + 1e-9) << "," << wins
+              << "," << draws << "," << losses << "," << double(plies) / std::max(games, 1) << "\n";
+    return bool(out);
+}
+
+//~~~~
+
+//~~~~ pdn.h
+
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+
+// PDN squares are numbered 1..32 with black on 1..12, moving first. Black is the bot here; the PDN board is
+// this one mirrored left to right, which the rules do not notice.
+inline int PdnSquare(int number) {
+    int index = number - 1;
+    return index / 4 * 4 + 3 - index % 4;
+}
+
+class PdnGame {
+public:
+    uint64_t number = 0;
+    std::string fen;
+    std::vector<std::pair<int, int>> moves;
+};
+
+// Splits a memory-mapped PDN file into games without copying it: tags are skipped except FEN, so are comments,
+// variations, move numbers and annotations. A move is a run of square numbers joined by - or x, only its first
+// and last squares are kept. A result token or the next tag after moves ends a game.
+class PdnReader {
+public:
+    const char *data;
+    size_t size;
+    size_t offset = 0;
+    uint64_t games = 0;
+
+    PdnReader(const uint8_t *new_data, size_t new_size) : data(reinterpret_cast<const char *>(new_data)),
+                                                         size(new_size) {
+    }
+
+    static bool IsResult(const std::string &token) {
+        return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*" || token == "2-0"
+               || token == "0-2" || token == "1-1";
+    }
+
+    // Skips to the character closing a bracket, nested the same way for variations.
+    void SkipTo(char open, char close) {
+        int depth = 0;
+        for (; offset < size; ++offset) {
+            depth += data[offset] == open;
+            depth -= data[offset] == close;
+            if (depth == 0) {
+                ++offset;
+                return;
+            }
+        }
+    }
+
+    bool Next(PdnGame *game) {
+        *game = PdnGame();
+        while (offset < size) {
+            char c = data[offset];
+            if (c == '[') {
+                if (!game->moves.empty()) {
+                    break;
+                }
+                size_t end = offset;
+                while (end < size && data[end] != ']') {
+                    ++end;
+                }
+                std::string tag(data + offset, end - offset);
+                if (tag.compare(0, 5, "[FEN ") == 0) {
+                    size_t first = tag.find('"');
+                    size_t last = tag.rfind('"');
+                    game->fen = first < last ? tag.substr(first + 1, last - first - 1) : "";
+                }
+                offset = std::min(end + 1, size);
+            } else if (c == '{') {
+                SkipTo('{', '}');
+            } else if (c == '(') {
+                SkipTo('(', ')');
+            } else if (std::isspace(static_cast<unsigned char>(c))) {
+                ++offset;
+            } else {
+                size_t end = offset;
+                while (end < size && !std::isspace(static_cast<unsigned char>(data[end])) && data[end] != '{'
+                       && data[end] != '(' && data[end] != '[') {
+                    ++end;
+                }
+                std::string token(data + offset, end - offset);
+                offset = end;
+                if (IsResult(token)) {
+                    break;
+                }
+                AddMove(token, game);
+            }
+        }
+        if (game->moves.empty() && offset >= size) {
+            return false;
+        }
+        game->number = games++;
+        return true;
+    }
+
+    static void AddMove(const std::string &token, PdnGame *game) {
+        std::vector<int> squares;
+        size_t i = 0;
+        while (i < token.size()) {
+            if (!std::isdigit(static_cast<unsigned char>(token[i]))) {
+                if (token[i] != '-' && token[i] != 'x' && token[i] != ':') {
+                    break;
+                }
+                ++i;
+                continue;
+            }
+            int number = 0;
+            while (i < token.size() && std::isdigit(static_cast<unsigned char>(token[i]))) {
+                number = number * 10 + token[i++] - '0';
+            }
+            if (i < token.size() && token[i] == '.') {
+                return;
+            }
+            squares.push_back(number);
+        }
+        if (squares.size() >= 2 && squares.front() >= 1 && squares.front() <= 32 && squares.back() >= 1
+            && squares.back() <= 32) {
+            game->moves.emplace_back(PdnSquare(squares.front()), PdnSquare(squares.back()));
+        }
+    }
+
+    // FEN as "B:W21,22,K30:B1,2-4" (side to move, then the pieces of each colour, K for kings, ranges allowed).
+    static bool FromFen(const std::string &fen, Board *board, Side *side) {
+        if (fen.empty()) {
+            *board = Board();
+            *side = Side::Bot;
+            return true;
+        }
+        std::string squares(32, '.');
+        std::istringstream fields(fen);
+        std::string field;
+        *side = fen[0] == 'W' ? Side::User : Side::Bot;
+        std::getline(fields, field, ':');
+        while (std::getline(fields, field, ':')) {
+            if (field.empty()) {
+                continue;
+            }
+            char colour = field[0] == 'W' ? 'u' : 'b';
+            std::istringstream pieces(field.substr(1));
+            std::string piece;
+            while (std::getline(pieces, piece, ',')) {
+                bool king = !piece.empty() && piece[0] == 'K';
+                std::string range = king ? piece.substr(1) : piece;
+                size_t dash = range.find('-');
+                int first = std::atoi(range.c_str());
+                int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+                for (int number = first; number <= last; ++number) {
+                    if (number < 1 || number > 32) {
+                        return false;
+                    }
+                    squares[PdnSquare(number)] = char(king ? std::toupper(colour) : colour);
+                }
+            }
+        }
+        *board = Board::FromString(squares);
+        return true;
+    }
+};
+
+// Columns of the analysis file, written in row groups: every group is the row count followed by each column's
+// values for those rows in this order.
+class AnalysisRow {
+public:
+    uint32_t game;
+    uint16_t ply;
+    uint8_t from;
+    uint8_t to;
+    int32_t best_score;
+    int32_t played_score;
+    int32_t loss;
+    uint8_t blunder;
+};
+
+class AnalysisWriter {
+public:
+    static constexpr uint32_t kMagic = 0x4E414B43u;
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kGroupRows = 65536;
+    static constexpr const char *kColumns = "game:u32,ply:u16,from:u8,to:u8,best_score:i32,played_score:i32,"
+                                            "loss:i32,blunder:u8";
+
+    std::ofstream out;
+    std::vector<AnalysisRow> rows;
+    uint64_t written = 0;
+
+    explicit AnalysisWriter(const std::string &path) : out(path, std::ios::binary) {
+        uint32_t header[3] = {kMagic, kVersion, uint32_t(std::strlen(kColumns))};
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        out.write(kColumns, std::streamsize(header[2]));
+    }
+
+    template <class Field>
+    void WriteColumn(Field AnalysisRow::*field) {
+        std::vector<Field> column(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            column[i] = rows[i].*field;
+        }
+        out.write(reinterpret_cast<const char *>(column.data()), std::streamsize(column.size() * sizeof(Field)));
+    }
+
+    void Add(const std::vector<AnalysisRow> &game_rows) {
+        rows.insert(rows.end(), game_rows.begin(), game_rows.end());
+        if (rows.size() >= kGroupRows) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        if (rows.empty()) {
+            return;
+        }
+        uint32_t count = uint32_t(rows.size());
+        out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        WriteColumn(&AnalysisRow::game);
+        WriteColumn(&AnalysisRow::ply);
+        WriteColumn(&AnalysisRow::from);
+        WriteColumn(&AnalysisRow::to);
+        WriteColumn(&AnalysisRow::best_score);
+        WriteColumn(&AnalysisRow::played_score);
+        WriteColumn(&AnalysisRow::loss);
+        WriteColumn(&AnalysisRow::blunder);
+        written += rows.size();
+        rows.clear();
+    }
+};
+
+// Replays a game and searches every position single-threaded. The played move is scored by the search of the
+// position it leads to, and its loss is how much worse that is for the mover than the best score.
+inline std::vector<AnalysisRow> AnalyseGame(const PdnGame &game, const SearchLimits &limits,
+                                            const std::shared_ptr<TranspositionTable> &table,
+                                            const std::shared_ptr<const Network> &network, int blunder) {
+    std::vector<AnalysisRow> rows;
+    Board board;
+    Side side;
+    if (!PdnReader::FromFen(game.fen, &board, &side)) {
+        return rows;
+    }
+    board.table = table;
+    board.SetNetwork(network);
+    auto score_of = [&](Board &position, Side to_move, Move *best) {
+        auto moves = position.CurrentMoves(to_move);
+        if (moves.empty()) {
+            return to_move == Side::Bot ? -Evaluation::kWin : Evaluation::kWin;
+        }
+        std::unique_ptr<Search> search(new Search(position, limits));
+        auto result = search->Run(moves, to_move);
+        if (best) {
+            *best = moves[result.move_index];
+        }
+        return result.score;
+    };
+
+    Move best;
+    int score = score_of(board, side, &best);
+    for (size_t ply = 0; ply < game.moves.size(); ++ply) {
+        auto moves = board.CurrentMoves(side);
+        Move *move = std::find_if(moves.begin(), moves.end(), [&game, ply](const Move &m) {
+            return m.from == game.moves[ply].first && m.final_square == game.moves[ply].second;
+        });
+        if (move == moves.end()) {
+            break;
+        }
+        board.ImplementMove(move);
+        int played = score_of(board, Opponent(side), &best);
+        int loss = side == Side::Bot ? score - played : played - score;
+        rows.push_back({uint32_t(game.number), uint16_t(ply), move->from, move->final_square, score, played,
+                        std::max(loss, 0), uint8_t(loss >= blunder)});
+        score = played;
+        side = Opponent(side);
+    }
+    return rows;
+}
+
+// The reading thread hands games to the workers through a bounded queue, so memory stays flat however large
+// the file is. Every worker has its own transposition table, hash_megabytes split evenly between them; rows are
+// written in row groups as games finish.
+inline bool RunAnalysis(const std::string &pdn_path, const std::string &output_path, const SearchLimits &limits,
+                        int workers, size_t hash_megabytes, int blunder,
+                        const std::shared_ptr<const Network> &network) {
+    workers = std::max(workers, 1);
+    MappedFile file;
+    if (!file.Open(pdn_path)) {
+        std::cerr << "Cannot map " << pdn_path << "\n";
+        return false;
+    }
+    madvise(const_cast<uint8_t *>(file.data), file.size, MADV_SEQUENTIAL);
+    AnalysisWriter writer(output_path);
+    if (!writer.out) {
+        std::cerr << "Cannot write " << output_path << "\n";
+        return false;
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<PdnGame> queue;
+    bool done = false;
+    uint64_t positions = 0;
+    uint64_t blunders = 0;
+    auto start = Search::Clock::now();
+    size_t table_megabytes = std::max<size_t>(hash_megabytes / size_t(workers), 1);
+
+    std::vector<std::thread> threads;
+    for (int id = 0; id < workers; ++id) {
+        threads.emplace_back([&]() {
+            auto table = std::make_shared<TranspositionTable>(table_megabytes);
+            while (true) {
+                PdnGame game;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&]() { return done || !queue.empty(); });
+                    if (queue.empty()) {
+                        return;
+                    }
+                    game = std::move(queue.front());
+                    queue.pop_front();
+                }
+                changed.notify_all();
+                auto rows = AnalyseGame(game, limits, table, network, blunder);
+                std::lock_guard<std::mutex> lock(mutex);
+                positions += rows.size();
+                for (const AnalysisRow &row: rows) {
+                    blunders += row.blunder;
+                }
+                writer.Add(rows);
+            }
+        });
+    }
+
+    PdnReader reader(file.data, file.size);
+    PdnGame game;
+    while (reader.Next(&game)) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return queue.size() < size_t(4 * workers); });
+        queue.push_back(std::move(game));
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    changed.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    writer.Flush();
+
+    double ms = std::chrono::duration<double, std::milli>(Search::Clock::now() - start).count();
+    std::cout << "games,positions,blunders,ms,positions_per_s\n"
+              << reader.games << "," << positions << "," << blunders << "," << int64_t(ms) << ","
+              << positions / (ms / 1000 + 1e-9) << "\n";
+    return bool(writer.out);
+}
+
+//~~~~
+
+//~~~~ network_trainer.h
+
+// Float copy of the network trained on self-play records and quantised into a Network. The target of a position
+// blends the game result from the bot's point of view (1, 0.5 or 0) with the handcrafted evaluation squashed the
+// same way, half and half, and the loss is the squared difference to sigmoid of the output.
+class NetworkTrainer {
+public:
+    static constexpr int kInputs = Network::kInputs;
+    static constexpr int kHidden = Network::kHidden;
+    static constexpr int kHidden2 = Network::kHidden2;
+    static constexpr float kResultWeight = 0.5f;
+
+    class Sample {
+    public:
+        Position position;
+        float target;
+    };
+
+    float w1[kInputs][kHidden];
+    float b1[kHidden];
+    float w2[kHidden2][kHidden];
+    float b2[kHidden2];
+    float w3[kHidden2];
+    float b3;
+    std::vector<Sample> samples;
+
+    explicit NetworkTrainer(unsigned seed = 1) : b3(0) {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> small(-0.1f, 0.1f);
+        for (auto &row: w1) {
+            for (float &weight: row) {
+                weight = small(generator);
+            }
+        }
+        for (auto &row: w2) {
+            for (float &weight: row) {
+                weight = small(generator) * 3;
+            }
+        }
+        for (float &weight: w3) {
+            weight = small(generator) * 3;
+        }
+        std::fill(b1, b1 + kHidden, 0.25f);
+        std::fill(b2, b2 + kHidden2, 0.25f);
+    }
+
+    static float Sigmoid(float x) {
+        return 1 / (1 + std::exp(-x));
+    }
+
+    // Replays every record and keeps the positions where the side to move has no capture.
+    size_t AddRecords(std::istream &in) {
+        std::string line;
+        size_t before = samples.size();
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string number, squares, to_move, token;
+            std::vector<std::string> tokens;
+            if (!(fields >> number >> squares >> to_move)) {
+                continue;
+            }
+            while (fields >> token) {
+                tokens.push_back(token);
+            }
+            if (tokens.empty()) {
+                continue;
+            }
+            float result = tokens.back() == "bot" ? 1.0f : tokens.back() == "user" ? 0.0f : 0.5f;
+            tokens.pop_back();
+            Board board = Board::FromString(squares);
+            Side side = to_move == "b" ? Side::Bot : Side::User;
+            for (const std::string &text: tokens) {
+                auto moves = board.CurrentMoves(side);
+                Move *move = std::find_if(moves.begin(), moves.end(), [&text](const Move &m) {
+                    return Board::MoveText(m) == text;
+                });
+                if (move == moves.end()) {
+                    break;
+                }
+                if (!move->eaten) {
+                    float evaluation = Sigmoid(float(board.Score(side)) / Network::kOutputScale);
+                    samples.push_back({board.position, kResultWeight * result + (1 - kResultWeight) * evaluation});
+                }
+                board.ImplementMove(move);
+                side = Opponent(side);
+            }
+        }
+        return samples.size() - before;
+    }
+
+    // One stochastic gradient step on a sample, returns its loss before the step.
+    float Train(const Sample &sample, float rate) {
+        int features[32];
+        int count = 0;
+        for (uint32_t rest = sample.position.bot | sample.position.user; rest; rest &= rest - 1) {
+            int square = LowestSquare(rest);
+            features[count++] = Network::Feature(sample.position.SideAt(square), sample.position.IsKing(square),
+                                                 square);
+        }
+
+        float h1[kHidden], a1[kHidden], h2[kHidden2], a2[kHidden2];
+        for (int j = 0; j < kHidden; ++j) {
+            h1[j] = b1[j];
+            for (int f = 0; f < count; ++f) {
+                h1[j] += w1[features[f]][j];
+            }
+            a1[j] = std::min(std::max(h1[j], 0.0f), 1.0f);
+        }
+        float y = b3;
+        for (int o = 0; o < kHidden2; ++o) {
+            h2[o] = b2[o];
+            for (int j = 0; j < kHidden; ++j) {
+                h2[o] += w2[o][j] * a1[j];
+            }
+            a2[o] = std::min(std::max(h2[o], 0.0f), 1.0f);
+            y += w3[o] * a2[o];
+        }
+
+        float p = Sigmoid(y);
+        float error = p - sample.target;
+        float g = 2 * error * p * (1 - p) * rate;
+        float g1[kHidden] = {};
+        for (int o = 0; o < kHidden2; ++o) {
+            float g2 = h2[o] > 0 && h2[o] < 1 ? g * w3[o] : 0;
+            w3[o] = std::min(std::max(w3[o] - g * a2[o], -1.98f), 1.98f);
+            if (g2 == 0) {
+                continue;
+            }
+            for (int j = 0; j < kHidden; ++j) {
+                g1[j] += g2 * w2[o][j];
+                w2[o][j] = std::min(std::max(w2[o][j] - g2 * a1[j], -1.98f), 1.98f);
+            }
+            b2[o] -= g2;
+        }
+        b3 -= g;
+        for (int j = 0; j < kHidden; ++j) {
+            if (h1[j] <= 0 || h1[j] >= 1) {
+                continue;
+            }
+            for (int f = 0; f < count; ++f) {
+                w1[features[f]][j] = std::min(std::max(w1[features[f]][j] - g1[j], -8.0f), 8.0f);
+            }
+            b1[j] -= g1[j];
+        }
+        return error * error;
+    }
+
+    void Run(int epochs, float rate) {
+        std::mt19937 generator(2);
+        for (int epoch = 0; epoch < epochs; ++epoch) {
+            std::shuffle(samples.begin(), samples.end(), generator);
+            double loss = 0;
+            for (const Sample &sample: samples) {
+                loss += Train(sample, rate);
+            }
+            std::cerr << "Epoch " << epoch + 1 << ": loss " << loss / std::max<size_t>(samples.size(), 1) << "\n";
+        }
+    }
+
+    static int Round(float value, int limit) {
+        return std::min(std::max(int(std::lround(value)), -limit), limit);
+    }
+
+    void Quantise(Network &network) const {
+        for (int f = 0; f < kInputs; ++f) {
+            for (int j = 0; j < kHidden; ++j) {
+                network.input_weights[f][j] = int16_t(Round(w1[f][j] * 127, 32767));
+            }
+        }
+        for (int j = 0; j < kHidden; ++j) {
+            network.input_bias[j] = int16_t(Round(b1[j] * 127, 32767));
+        }
+        for (int o = 0; o < kHidden2; ++o) {
+            for (int j = 0; j < kHidden; ++j) {
+                network.hidden_weights[o][j] = int8_t(Round(w2[o][j] * 64, 127));
+            }
+            network.hidden_bias[o] = Round(b2[o] * 127 * 64, 1 << 30);
+            network.output_weights[o] = int8_t(Round(w3[o] * 64, 127));
+        }
+        network.output_bias = Round(b3 * 127 * 64, 1 << 30);
+    }
+};
+
+// Evaluations per second of the network with the selected kernel and with the scalar one, over the positions of a
+// few random games. Both kernels have to agree on every position.
+inline bool RunNetworkBench(const Network &network, int evaluations) {
+    Network scalar = network;
+    scalar.SelectKernel(false);
+    std::vector<Accumulator> accumulators;
+    for (unsigned seed = 0; seed < 64; ++seed) {
+        Board board = RandomPosition(seed, int(seed % 40));
+        accumulators.emplace_back();
+        network.Refresh(board.position, accumulators.back());
+    }
+    bool agree = true;
+    for (const Accumulator &accumulator: accumulators) {
+        agree = agree && network.Evaluate(accumulator) == scalar.Evaluate(accumulator);
+    }
+
+    std::cout << "kernel,evaluations,ms,evaluations_per_s,checksum\n";
+    const Network *kernels[] = {&network, &scalar};
+    for (const Network *current: kernels) {
+        int64_t checksum = 0;
+        auto start = Search::Clock::now();
+        for (int i = 0; i < evaluations; ++i) {
+            checksum += current->Evaluate(accumulators[i % accumulators.size()]);
+        }
+        double ms = std::chrono::duration<double, std::milli>(Search::Clock::now() - start).count();
+        std::cout << current->kernel << "," << evaluations << "," << int64_t(ms) << ","
+                  << uint64_t(evaluations / (ms / 1000 + 1e-9)) << "," << checksum << "\n";
+    }
+    std::cout << (agree ? "kernels agree\n" : "kernels DIFFER\n");
+    return agree;
+}
+
+//~~~~
+
+//~~~~ protocol.h
+
+// Plays the move of side written as Board::MoveText, returns false if there is no such move.
+inline bool PlayMove(Board &board, Side side, const std::string &text) {
+    auto moves = board.CurrentMoves(side);
+    Move *move = std::find_if(moves.begin(), moves.end(), [&text](const Move &m) {
+        return Board::MoveText(m) == text;
+    });
+    if (move == moves.end()) {
+        return false;
+    }
+    board.ImplementMove(move);
+    return true;
+}
+
+// Line-based engine protocol over standard input and output:
+//   position startpos | <32 squares> [b|u]   set the position and the side to move (u by default)
+//   move <from-to>                           play a move for the side to move
+//   limits depth N time MS nodes N threads N set the search limits, any subset
+//   go [infinite]                            search in the background, answers with an info line per depth and
+//                                            bestmove
+//   stop                                     stop the search, which still answers with bestmove
+//   newgame, isready, quit
+// Moves use the board's own square numbers, 0..31 as in Board::MoveText, not the 1..32 of PDN files: PDN square
+// n is PdnSquare(n) here. Output is collected in one buffer and written when no more input is waiting or a search
+// finishes, reports or fails a command.
+class EngineProtocol {
+public:
+    Board board;
+    Side side = Side::User;
+    SearchLimits limits;
+    std::atomic<bool> stop;
+    std::thread worker;
+    std::mutex output_mutex;
+    std::string output;
+
+    EngineProtocol(size_t hash_megabytes, const SearchLimits &new_limits) : limits(new_limits), stop(false) {
+        board.table = std::make_shared<TranspositionTable>(hash_megabytes);
+    }
+
+    void Write(const std::string &text, bool flush) {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        output += text;
+        if (flush) {
+            std::cout.write(output.data(), std::streamsize(output.size()));
+            std::cout.flush();
+            output.clear();
+        }
+    }
+
+    void Run() {
+        std::string line;
+        while (std::getline(std::cin, line) && Handle(line)) {
+            Write("", std::cin.rdbuf()->in_avail() <= 0);
+        }
+        Stop();
+        Write("", true);
+    }
+
+    void Stop() {
+        stop = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Replays the line on a copy of root to spell its moves, stopping at the first one that does not fit.
+    static std::string LineText(Board root, Side side, const std::vector<MoveKey> &line) {
+        std::string text;
+        for (const MoveKey &key: line) {
+            auto moves = root.CurrentMoves(side);
+            Move *move = std::find_if(moves.begin(), moves.end(), [&key](const Move &m) { return key.Matches(m); });
+            if (move == moves.end()) {
+                break;
+            }
+            text += " " + Board::MoveText(*move);
+            root.ImplementMove(move);
+            side = Opponent(side);
+        }
+        return text;
+    }
+
+    void Go(bool infinite) {
+        Stop();
+        stop = false;
+        SearchLimits search_limits = limits;
+        search_limits.stop = &stop;
+        if (infinite) {
+            search_limits.soft_ms = std::numeric_limits<int>::max();
+            search_limits.hard_ms = std::numeric_limits<int>::max();
+        }
+        search_limits.on_iteration = [this, root = board, to_move = side](const SearchResult &partial) {
+            const SearchIteration &iteration = partial.iterations.back();
+            std::ostringstream text;
+            text << "info depth " << iteration.depth << " score " << iteration.score << " nodes " << iteration.nodes
+                 << " time " << iteration.ms << " pv" << LineText(root, to_move, partial.pv) << "\n";
+            Write(text.str(), true);
+        };
+        worker = std::thread([this, root = board, to_move = side, search_limits]() {
+            auto moves = root.CurrentMoves(to_move);
+            if (moves.empty()) {
+                Write("bestmove none\n", true);
+                return;
+            }
+            auto result = ParallelSearch(root, moves, search_limits, to_move);
+            std::ostringstream text;
+            text << "info nodes " << result.nodes << " pv" << LineText(root, to_move, result.pv) << "\n"
+                 << "bestmove " << Board::MoveText(moves[result.move_index]) << "\n";
+            Write(text.str(), true);
+        });
+    }
+
+    // Returns false on quit.
+    bool Handle(const std::string &line) {
+        std::istringstream fields(line);
+        std::string command;
+        if (!(fields >> command)) {
+            return true;
+        }
+        if (command == "quit") {
+            return false;
+        }
+        if (command == "isready") {
+            Write("readyok\n", false);
+        } else if (command == "stop") {
+            Stop();
+        } else if (command == "go") {
+            std::string mode;
+            Go(fields >> mode && mode == "infinite");
+        } else if (command == "newgame") {
+            Stop();
+            SetPosition(Board(), Side::User);
+            board.table->Clear();
+        } else if (command == "position") {
+            std::string squares;
+            std::string to_move;
+            fields >> squares >> to_move;
+            Stop();
+            SetPosition(squares == "startpos" ? Board() : Board::FromString(squares),
+                        to_move == "b" ? Side::Bot : Side::User);
+        } else if (command == "move") {
+            std::string text;
+            fields >> text;
+            Stop();
+            if (PlayMove(board, side, text)) {
+                side = Opponent(side);
+            } else {
+                Write("error illegal move " + text + "\n", false);
+            }
+        } else if (command == "limits") {
+            std::string name;
+            while (fields >> name) {
+                long long value;
+                if (!(fields >> value)) {
+                    Write("error limit " + name + " needs a number\n", false);
+                    break;
+                }
+                if (!limits.Set(name, value)) {
+                    Write("error unknown limit " + name + "\n", false);
+                }
+            }
+        } else {
+            Write("error unknown command " + command + "\n", false);
+        }
+        return true;
+    }
+
+    void SetPosition(Board new_board, Side to_move) {
+        new_board.table = board.table;
+        new_board.tablebase = board.tablebase;
+        new_board.book = board.book;
+        new_board.SetNetwork(board.network);
+        board = new_board;
+        side = to_move;
+    }
+};
+
+//~~~~
+
+//~~~~ server.h
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+class ServerSession {
+public:
+    int client;
+    Board board;
+    Side side = Side::User;
+    SearchLimits limits;
+    bool searching = false;
+};
+
+class SearchJob {
+public:
+    int session;
+    Board board;
+    Side side;
+    SearchLimits limits;
+    Search::Clock::time_point queued;
+};
+
+class JobResult {
+public:
+    int session;
+    std::string text;
+};
+
+// Hosts game sessions for many clients on a local socket. Every line a client sends is either "new", which
+// answers "<id> session", "stats", "shutdown", or "<id> <command>" for one of its sessions with the commands
+// position, move, limits and go of the engine protocol plus close. Replies start with the session id.
+//
+// One thread runs the sockets with poll. Searches go to a pool of workers through one FIFO queue that holds at
+// most one search per session, so sessions are served in turn. Every search is single-threaded and its time is
+// capped by the server's own --time budget. All sessions share one transposition table, the mapped opening book
+// and tablebase and the network. Workers hand results back through a queue and wake the socket thread with a
+// pipe.
+class GameServer {
+public:
+    SearchLimits defaults;
+    std::shared_ptr<TranspositionTable> table;
+    std::shared_ptr<const Tablebase> tablebase;
+    std::shared_ptr<const OpeningBook> book;
+    std::shared_ptr<const Network> network;
+    int worker_count;
+
+    std::map<int, ServerSession> sessions;
+    int next_session = 1;
+    std::map<int, std::string> inputs;
+    std::map<int, std::string> outputs;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<SearchJob> queue;
+    std::vector<JobResult> finished;
+    bool stopping = false;
+    int wake[2] = {-1, -1};
+
+    uint64_t searches = 0;
+    uint64_t nodes = 0;
+    double queue_ms_total = 0;
+    double queue_ms_max = 0;
+    Search::Clock::time_point started;
+
+    GameServer(const SearchLimits &new_defaults, size_t hash_megabytes, int workers) : defaults(new_defaults),
+                                                                                      worker_count(std::max(workers, 1)) {
+        defaults.threads = 1;
+        table = std::make_shared<TranspositionTable>(hash_megabytes);
+    }
+
+    void Reply(int session, const std::string &text) {
+        auto it = sessions.find(session);
+        if (it != sessions.end()) {
+            outputs[it->second.client] += std::to_string(session) + " " + text + "\n";
+        }
+    }
+
+    std::string Stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        double seconds = std::chrono::duration<double>(Search::Clock::now() - started).count();
+        std::ostringstream text;
+        text << "stats sessions " << sessions.size() << " queued " << queue.size() << " searches " << searches
+             << " searches_per_s " << searches / std::max(seconds, 1e-9) << " nodes_per_s "
+             << uint64_t(nodes / std::max(seconds, 1e-9)) << " queue_ms_avg "
+             << queue_ms_total / std::max<uint64_t>(searches, 1) << " queue_ms_max " << queue_ms_max;
+        return text.str();
+    }
+
+    void Work() {
+        while (true) {
+            SearchJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = queue.front();
+                queue.pop_front();
+            }
+            double queue_ms = std::chrono::duration<double, std::milli>(Search::Clock::now() - job.queued).count();
+            JobResult result = {job.session, Answer(job.board, job.side, job.limits)};
+            std::lock_guard<std::mutex> lock(mutex);
+            ++searches;
+            queue_ms_total += queue_ms;
+            queue_ms_max = std::max(queue_ms_max, queue_ms);
+            finished.push_back(result);
+            if (write(wake[1], "x", 1) < 0) {
+                std::cerr << "Cannot wake the server\n";
+            }
+        }
+    }
+
+    // The book move, the tablebase move or the searched one, like BotMove.
+    std::string Answer(Board &board, Side side, const SearchLimits &limits) {
+        auto moves = board.CurrentMoves(side);
+        if (moves.empty()) {
+            return "bestmove none";
+        }
+        const OpeningBook::Entry *entry = nullptr;
+        int index = board.book && side == Side::Bot ? board.book->BestMove(board, moves, &entry) : -1;
+        if (index >= 0) {
+            return "bestmove " + Board::MoveText(moves[index]) + " book";
+        }
+        index = board.tablebase ? board.tablebase->BestMove(board, moves, side) : -1;
+        if (index >= 0) {
+            return "bestmove " + Board::MoveText(moves[index]) + " tablebase";
+        }
+        auto result = ParallelSearch(board, moves, limits, side);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            nodes += result.nodes;
+        }
+        return "bestmove " + Board::MoveText(moves[result.move_index]) + " score " + std::to_string(result.score)
+               + " depth " + std::to_string(result.depth) + " nodes " + std::to_string(result.nodes);
+    }
+
+    // Returns false on shutdown.
+    bool Handle(int client, const std::string &line) {
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first)) {
+            return true;
+        }
+        if (first == "shutdown") {
+            return false;
+        }
+        if (first == "stats") {
+            outputs[client] += Stats() + "\n";
+            return true;
+        }
+        if (first == "new") {
+            int id = next_session++;
+            ServerSession &session = sessions[id];
+            session.client = client;
+            session.limits = defaults;
+            session.board.table = table;
+            session.board.tablebase = tablebase;
+            session.board.book = book;
+            session.board.SetNetwork(network);
+            Reply(id, "session");
+            return true;
+        }
+
+        int id = std::atoi(first.c_str());
+        auto it = sessions.find(id);
+        std::string command;
+        if (it == sessions.end() || it->second.client != client || !(fields >> command)) {
+            outputs[client] += "error unknown session " + first + "\n";
+            return true;
+        }
+        ServerSession &session = it->second;
+        if (session.searching && command != "close") {
+            Reply(id, "error searching");
+        } else if (command == "close") {
+            sessions.erase(it);
+        } else if (command == "go") {
+            session.searching = true;
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back({id, session.board, session.side, session.limits, Search::Clock::now()});
+            ready.notify_one();
+        } else if (command == "position") {
+            std::string squares;
+            std::string to_move;
+            fields >> squares >> to_move;
+            Board board = squares == "startpos" ? Board() : Board::FromString(squares);
+            board.table = table;
+            board.tablebase = tablebase;
+            board.book = book;
+            board.SetNetwork(network);
+            session.board = board;
+            session.side = to_move == "b" ? Side::Bot : Side::User;
+            Reply(id, "ok");
+        } else if (command == "move") {
+            std::string text;
+            fields >> text;
+            if (PlayMove(session.board, session.side, text)) {
+                session.side = Opponent(session.side);
+                Reply(id, "ok");
+            } else {
+                Reply(id, "error illegal move " + text);
+            }
+        } else if (command == "limits") {
+            std::string name;
+            long long value;
+            while (fields >> name >> value) {
+                if (!session.limits.Set(name, value) || name == "threads") {
+                    Reply(id, "error unknown limit " + name);
+                }
+            }
+            session.limits.threads = 1;
+            session.limits.soft_ms = std::min(session.limits.soft_ms, defaults.soft_ms);
+            session.limits.hard_ms = std::min(session.limits.hard_ms, defaults.hard_ms);
+            Reply(id, "ok");
+        } else {
+            Reply(id, "error unknown command " + command);
+        }
+        return true;
+    }
+
+    void Disconnect(int client) {
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            it = it->second.client == client ? sessions.erase(it) : std::next(it);
+        }
+        inputs.erase(client);
+        outputs.erase(client);
+        close(client);
+    }
+
+    bool Run(const std::string &path) {
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        unlink(path.c_str());
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || listen(listener, 128) != 0 || pipe(wake) != 0) {
+            std::cerr << "Cannot listen on " << path << "\n";
+            return false;
+        }
+        fcntl(listener, F_SETFL, O_NONBLOCK);
+        started = Search::Clock::now();
+        std::vector<std::thread> workers;
+        for (int i = 0; i < worker_count; ++i) {
+            workers.emplace_back([this]() { Work(); });
+        }
+        std::cerr << "Listening on " << path << " with " << worker_count << " workers\n";
+
+        bool running = true;
+        while (running) {
+            std::vector<pollfd> polled = {{listener, POLLIN, 0}, {wake[0], POLLIN, 0}};
+            for (const auto &input: inputs) {
+                short events = POLLIN | (outputs[input.first].empty() ? 0 : POLLOUT);
+                polled.push_back({input.first, events, 0});
+            }
+            if (poll(polled.data(), polled.size(), -1) < 0) {
+                continue;
+            }
+            if (polled[0].revents & POLLIN) {
+                for (int client; (client = accept(listener, nullptr, nullptr)) >= 0;) {
+                    fcntl(client, F_SETFL, O_NONBLOCK);
+                    inputs[client];
+                }
+            }
+            if (polled[1].revents & POLLIN) {
+                char drain[256];
+                if (read(wake[0], drain, sizeof(drain)) < 0) {
+                    std::cerr << "Cannot read the wake pipe\n";
+                }
+                std::vector<JobResult> results;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results.swap(finished);
+                }
+                for (const JobResult &result: results) {
+                    auto it = sessions.find(result.session);
+                    if (it != sessions.end()) {
+                        it->second.searching = false;
+                        Reply(result.session, result.text);
+                    }
+                }
+            }
+            for (size_t i = 2; i < polled.size() && running; ++i) {
+                int client = polled[i].fd;
+                if (polled[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    char buffer[4096];
+                    ssize_t count = read(client, buffer, sizeof(buffer));
+                    if (count <= 0) {
+                        Disconnect(client);
+                        continue;
+                    }
+                    std::string &input = inputs[client];
+                    input.append(buffer, size_t(count));
+                    size_t end;
+                    while (running && (end = input.find('\n')) != std::string::npos) {
+                        std::string line = input.substr(0, end);
+                        input.erase(0, end + 1);
+                        running = Handle(client, line);
+                    }
+                }
+            }
+            for (auto &output: outputs) {
+                if (!output.second.empty()) {
+                    ssize_t count = send(output.first, output.second.data(), output.second.size(), MSG_NOSIGNAL);
+                    if (count > 0) {
+                        output.second.erase(0, size_t(count));
+                    }
+                }
+            }
+        }
+
+        std::cerr << Stats() << "\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto &worker: workers) {
+            worker.join();
+        }
+        for (const auto &input: inputs) {
+            close(input.first);
+        }
+        close(listener);
+        unlink(path.c_str());
+        return true;
+    }
+};
+
+//~~~~
+
+//~~~~ cluster.h
 
-enum class Side {
-    NoOne,
-    Bot,
-    User,
-};
+#include <cerrno>
+#include <cstdio>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
-class Piece {
+using TableEntries = std::vector<std::pair<uint64_t, TableEntry>>;
+
+// A position searched to a fixed depth by one worker, with the table entries already known for it. A worker
+// gives up on the unit after ms, 0 for never.
+class WorkUnit {
 public:
+    int id;
+    Board board;
     Side side;
-    std::pair<int, int> position;
-    bool is_king;
-
-    Piece() : side(Side::NoOne), is_king(false) {
-    }
+    int depth;
+    TableEntries entries;
+    int ms = 0;
 };
 
-class Move {
+class UnitResult {
 public:
-    Piece *piece;
-    std::vector<Piece *> pieces_eaten;
-    std::pair<int, int> final_position;
-    bool is_final;
-    bool fake = false;
+    int score = 0;
+    uint64_t nodes = 0;
+    std::vector<MoveKey> pv;
+    TableEntries entries;
+};
 
-    explicit Move(Piece *new_piece, std::pair<int, int> new_position, bool new_is_final) : piece(
-            new_piece),
-                                                                                           pieces_eaten(
-                                                                                                   std::vector<Piece *>()),
-                                                                                           final_position(
-                                                                                                   std::move(
-                                                                                                           new_position)),
-                                                                                           is_final(
-                                                                                                   new_is_final) {
+// Entries travel as key,score,depth,bound,from,to with the key in hex.
+inline std::string EntryText(uint64_t key, const TableEntry &entry) {
+    std::ostringstream text;
+    text << std::hex << key << std::dec << "," << entry.score << "," << entry.depth << "," << int(entry.bound) << ","
+         << entry.from << "," << entry.to;
+    return text.str();
+}
 
+inline bool ParseEntry(const std::string &text, uint64_t *key, TableEntry *entry) {
+    int bound;
+    unsigned long long value;
+    if (std::sscanf(text.c_str(), "%llx,%d,%d,%d,%d,%d", &value, &entry->score, &entry->depth, &bound, &entry->from,
+                    &entry->to) != 6) {
+        return false;
     }
+    *key = value;
+    entry->bound = Bound(bound);
+    return true;
+}
 
-    explicit Move(Piece *new_piece, std::pair<int, int> new_position, bool new_is_final, bool new_fake) : piece(
-            new_piece),
-                                                                                                          pieces_eaten(
-                                                                                                                  std::vector<Piece *>()),
-                                                                                                          final_position(
-                                                                                                                  std::move(
-                                                                                                                          new_position)),
-                                                                                                          is_final(
-                                                                                                                  new_is_final),
-                                                                                                          fake(new_fake) {
+// "unit <id> <squares> <b|u> <depth> <ms> <entry>..."
+inline std::string UnitText(const WorkUnit &unit) {
+    std::string text = "unit " + std::to_string(unit.id) + " " + unit.board.ToString() + " "
+                       + (unit.side == Side::Bot ? "b" : "u") + " " + std::to_string(unit.depth) + " "
+                       + std::to_string(unit.ms);
+    for (const auto &entry: unit.entries) {
+        text += " " + EntryText(entry.first, entry.second);
     }
-};
+    return text + "\n";
+}
 
-class Board {
-public:
-    using BoardType = std::vector<std::vector<Piece>>;
-    std::vector<Piece *> bot;
-    std::vector<Piece *> user;
-    size_t bot_kings;
-    size_t user_kings;
-    BoardType board;
+// "result <id> <score> <nodes> <from-to,...|-> <entry>..."
+inline std::string ResultText(int id, const UnitResult &result) {
+    std::string line;
+    for (const MoveKey &key: result.pv) {
+        line += (line.empty() ? "" : ",") + std::to_string(key.from) + "-" + std::to_string(key.to);
+    }
+    std::string text = "result " + std::to_string(id) + " " + std::to_string(result.score) + " "
+                       + std::to_string(result.nodes) + " " + (line.empty() ? "-" : line);
+    for (const auto &entry: result.entries) {
+        text += " " + EntryText(entry.first, entry.second);
+    }
+    return text + "\n";
+}
 
-    Board() : board(BoardType(8, std::vector<Piece>(8))),
-              bot_kings(0),
-              user_kings(0) {
-        for (size_t i = 0; i < 8; ++i) {
-            for (size_t j = 0; j < 8; ++j) {
-                if (i < 3 && (i + j) % 2 == 0) {
-                    board[i][j].position = std::make_pair(i, j);
-                    board[i][j].side = Side::Bot;
-                    bot.push_back(&board[i][j]);
-                } else if (i >= 5 && (i + j) % 2 == 0) {
-                    board[i][j].position = std::make_pair(i, j);
-                    board[i][j].side = Side::User;
-                    user.push_back(&board[i][j]);
-                } else {
-                    board[i][j].position = std::make_pair(i, j);
-                    board[i][j].side = Side::NoOne;
-                }
-            }
+inline bool ParseResult(const std::string &line, int *id, UnitResult *result) {
+    std::istringstream fields(line);
+    std::string word;
+    std::string pv;
+    if (!(fields >> word >> *id >> result->score >> result->nodes >> pv) || word != "result") {
+        return false;
+    }
+    std::istringstream moves(pv);
+    MoveKey key;
+    while (pv != "-" && std::getline(moves, word, ',') && std::sscanf(word.c_str(), "%d-%d", &key.from, &key.to) == 2) {
+        result->pv.push_back(key);
+    }
+    uint64_t entry_key;
+    TableEntry entry;
+    while (fields >> word) {
+        if (ParseEntry(word, &entry_key, &entry)) {
+            result->entries.emplace_back(entry_key, entry);
         }
     }
+    return true;
+}
 
-    Board(Board &other) : board(BoardType(8, std::vector<Piece>(8))),
-                          bot_kings(other.bot_kings),
-                          user_kings(other.user_kings) {
-        for (int i = 0; i < 8; ++i) {
-            for (int j = 0; j < 8; ++j) {
-                board[i][j].side = other.board[i][j].side;
-                board[i][j].position = other.board[i][j].position;
-                board[i][j].is_king = other.board[i][j].is_king;
-            }
-        }
+// Searches a unit on table after storing its entries there. The result carries the entries of the positions
+// along the principal variation, the unit's own position first. A unit out of time answers with the depth it
+// completed, which its coordinator has stopped waiting for by then.
+inline UnitResult SearchUnit(WorkUnit unit, const SearchLimits &limits,
+                             const std::shared_ptr<TranspositionTable> &table) {
+    UnitResult answer;
+    unit.board.table = table;
+    for (const auto &entry: unit.entries) {
+        table->Store(entry.first, entry.second);
+    }
+    auto moves = unit.board.CurrentMoves(unit.side);
+    if (moves.empty()) {
+        answer.score = unit.side == Side::Bot ? -Evaluation::kWin : Evaluation::kWin;
+        return answer;
+    }
+    SearchLimits unit_limits = BenchLimits(limits, unit.depth, 0);
+    if (unit.ms > 0) {
+        unit_limits.soft_ms = unit.ms;
+        unit_limits.hard_ms = unit.ms;
+    }
+    auto result = ParallelSearch(unit.board, moves, unit_limits, unit.side);
+    answer.score = result.score;
+    answer.nodes = result.nodes;
+    answer.pv = result.pv;
 
-        for (Piece *piece: other.user) {
-            user.push_back(&board[piece->position.first][piece->position.second]);
+    // The root of a search is not a node of its own, so its entry is made here, one ply deeper than its children.
+    const Move &best = moves[result.move_index];
+    answer.entries.push_back({unit.board.Key(unit.side),
+                              {result.score, result.depth + 1, Bound::Exact, best.from, best.final_square}});
+    Board board = unit.board;
+    Side side = unit.side;
+    for (const MoveKey &key: result.pv) {
+        auto replies = board.CurrentMoves(side);
+        Move *move = std::find_if(replies.begin(), replies.end(), [&key](const Move &m) { return key.Matches(m); });
+        if (move == replies.end()) {
+            break;
         }
-
-        for (Piece *piece: other.bot) {
-            bot.push_back(&board[piece->position.first][piece->position.second]);
+        board.ImplementMove(move);
+        side = Opponent(side);
+        TableEntry entry;
+        if (table->Probe(board.Key(side), &entry)) {
+            answer.entries.emplace_back(board.Key(side), entry);
         }
     }
+    return answer;
+}
 
-    void DeletePiece(Piece *piece) {
-        if (piece->side == Side::User) {
-            auto elem = std::find(user.begin(), user.end(), piece);
-            if (piece->is_king) {
-                --user_kings;
-            }
-            user.erase(elem);
-        } else {
-            auto elem = std::find(bot.begin(), bot.end(), piece);
-            if (piece->is_king) {
-                --bot_kings;
+// Connects to a coordinator, retrying for a while so workers can be started first, and answers its units until
+// it says quit or goes away. "clear" empties the worker's table.
+inline bool RunClusterWorker(const std::string &host, const std::string &port, const SearchLimits &limits,
+                             size_t hash_megabytes, const std::shared_ptr<const Network> &network) {
+    int connection = -1;
+    for (int attempt = 0; attempt < 100 && connection < 0; ++attempt) {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) == 0) {
+            for (addrinfo *address = addresses; address && connection < 0; address = address->ai_next) {
+                connection = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+                if (connection >= 0 && connect(connection, address->ai_addr, address->ai_addrlen) != 0) {
+                    close(connection);
+                    connection = -1;
+                }
             }
-            bot.erase(elem);
+            freeaddrinfo(addresses);
         }
-        piece->side = Side::NoOne;
-        piece->is_king = false;
-    }
-
-    static bool AllFinal(const std::deque<Move> &moves) {
-        for (const Move &move: moves) {
-            if (!move.is_final) {
-                return false;
-            }
+        if (connection < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
-        return true;
     }
-
-    static bool AlreadyEaten(const std::vector<Piece *> &eaten, int i, int j) {
-        for (Piece *piece: eaten) {
-            if (piece->position.first == i && piece->position.second == j) {
-                return true;
-            }
-        }
+    if (connection < 0) {
+        std::cerr << "Cannot connect to " << host << ":" << port << "\n";
         return false;
     }
+    int enable = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
 
-    std::deque<Move> CurrentMoves(Side side) {
-        std::deque<Move> moves;
-        std::vector<Piece *> &curr_player = side == Side::Bot ? bot : user;
-        bool go_up = side == Side::User;
-        Side opponent = side == Side::User ? Side::Bot : Side::User;
-
-        for (Piece *piece: curr_player) {
-            auto temp_move = Move(piece, piece->position, false, true);
-            auto curr_piece_moves = CalculatePossibleMoves(temp_move, opponent, go_up);
-            for (const Move &move: curr_piece_moves) {
-                moves.push_back(move);
+    auto table = std::make_shared<TranspositionTable>(hash_megabytes);
+    uint64_t units = 0;
+    std::string input;
+    char buffer[65536];
+    for (ssize_t count; (count = read(connection, buffer, sizeof(buffer))) > 0;) {
+        input.append(buffer, size_t(count));
+        for (size_t end; (end = input.find('\n')) != std::string::npos;) {
+            std::istringstream fields(input.substr(0, end));
+            input.erase(0, end + 1);
+            std::string command;
+            fields >> command;
+            if (command == "quit") {
+                close(connection);
+                std::cerr << "Searched " << units << " units\n";
+                return true;
             }
-        }
-
-        if (!AllFinal(moves)) {
-            for (auto it = moves.begin(); it != moves.end();) {
-                if (it->is_final) {
-                    it = moves.erase(it);
-                } else {
-                    ++it;
-                }
+            if (command == "clear") {
+                table->Clear();
+                continue;
             }
-        }
-
-        while (!AllFinal(moves)) {
-            Move curr_move = moves.back();
-            if (curr_move.is_final) {
-                moves.push_front(curr_move);
-                moves.pop_back();
+            WorkUnit unit;
+            std::string squares;
+            std::string to_move;
+            if (command != "unit" || !(fields >> unit.id >> squares >> to_move >> unit.depth >> unit.ms)) {
                 continue;
             }
-            moves.pop_back();
-            auto new_moves = CalculatePossibleMoves(curr_move, opponent, go_up);
-            for (const Move &new_move: new_moves) {
-                if (new_move.is_final) {
-                    moves.push_front(new_move);
-                } else {
-                    moves.push_back(new_move);
+            unit.board = Board::FromString(squares);
+            unit.board.SetNetwork(network);
+            unit.side = to_move == "b" ? Side::Bot : Side::User;
+            std::string word;
+            uint64_t key;
+            TableEntry entry;
+            while (fields >> word) {
+                if (ParseEntry(word, &key, &entry)) {
+                    unit.entries.emplace_back(key, entry);
                 }
             }
+            std::string reply = ResultText(unit.id, SearchUnit(unit, limits, table));
+            ++units;
+            if (send(connection, reply.data(), reply.size(), MSG_NOSIGNAL) != ssize_t(reply.size())) {
+                break;
+            }
         }
-        return moves;
     }
+    close(connection);
+    std::cerr << "Coordinator went away after " << units << " units\n";
+    return true;
+}
 
-    std::vector<Move> CalculatePossibleMoves(const Move &curr_move,
-                                             Side opponent,
-                                             bool go_up) {
-        auto[i, j] = curr_move.final_position;
-        std::vector<Move> moves;
-        bool has_to_fight = false;
-        if ((i + 1 < 8 && j + 1 < 8 && i + 2 < 8 && j + 2 < 8)
-            && board[i + 1][j + 1].side == opponent
-            && board[i + 2][j + 2].side == Side::NoOne
-            && (!go_up
-                || curr_move.piece->is_king
-                || !curr_move.pieces_eaten.empty())
-            && !AlreadyEaten(curr_move.pieces_eaten, i + 1, j + 1)) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i + 2, j + 2);
-            moves.back().pieces_eaten.push_back(&board[i + 1][j + 1]);
-            moves.back().is_final = false;
-            has_to_fight = true;
-        }
-
-        if ((i - 1 >= 0 && j + 1 < 8 && i - 2 >= 0 && j + 2 < 8)
-            && board[i - 1][j + 1].side == opponent
-            && board[i - 2][j + 2].side == Side::NoOne
-            && (go_up
-                || curr_move.piece->is_king
-                || !curr_move.pieces_eaten.empty())
-            && !AlreadyEaten(curr_move.pieces_eaten, i - 1, j + 1)) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i - 2, j + 2);
-            moves.back().pieces_eaten.push_back(&board[i - 1][j + 1]);
-            moves.back().is_final = false;
-            has_to_fight = true;
-        }
-
-        if ((i + 1 < 8 && j - 1 >= 0 && i + 2 < 8 && j - 2 >= 0)
-            && board[i + 1][j - 1].side == opponent
-            && board[i + 2][j - 2].side == Side::NoOne
-            && (!go_up
-                || curr_move.piece->is_king
-                || !curr_move.pieces_eaten.empty())
-            && !AlreadyEaten(curr_move.pieces_eaten, i + 1, j - 1)) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i + 2, j - 2);
-            moves.back().pieces_eaten.push_back(&board[i + 1][j - 1]);
-            moves.back().is_final = false;
-            has_to_fight = true;
-        }
-
-        if ((i - 1 >= 0 && j - 1 >= 0 && i - 2 >= 0 && j - 2 >= 0)
-            && board[i - 1][j - 1].side == opponent
-            && board[i - 2][j - 2].side == Side::NoOne
-            && (go_up
-                || curr_move.piece->is_king
-                || !curr_move.pieces_eaten.empty())
-            && !AlreadyEaten(curr_move.pieces_eaten, i - 1, j - 1)) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i - 2, j - 2);
-            moves.back().pieces_eaten.push_back(&board[i - 1][j - 1]);
-            moves.back().is_final = false;
-            has_to_fight = true;
-        }
-
-        if (has_to_fight) {
-            return moves;
-        }
+class ClusterWorker {
+public:
+    std::string input;
+    std::string output;
+    // Id of the unit being searched, -1 when idle. It can belong to a round Run has already given up on.
+    int unit = -1;
+    uint64_t units = 0;
+    uint64_t nodes = 0;
+};
 
-        if ((i - 1 >= 0 && j + 1 < 8 && (go_up || curr_move.piece->is_king))
-            && board[i - 1][j + 1].side == Side::NoOne && curr_move.pieces_eaten.empty()) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i - 1, j + 1);
-            moves.back().is_final = true;
-        }
+// Hands work units to workers connected over TCP, one unit per worker at a time, in queue order. The unit of a
+// worker that disconnects goes back to the front of the queue. While no worker is connected for kOrphanMs the
+// coordinator searches the next unit itself, so a batch always finishes. Only the first max_workers connections
+// get units, which is how the scaling report adds one worker at a time.
+class ClusterCoordinator {
+public:
+    static constexpr int kOrphanMs = 2000;
 
-        if ((i - 1 >= 0 && j - 1 >= 0 && (go_up || curr_move.piece->is_king))
-            && board[i - 1][j - 1].side == Side::NoOne && curr_move.pieces_eaten.empty()) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i - 1, j - 1);
-            moves.back().is_final = true;
-        }
+    int listener = -1;
+    // Every Run numbers its units from here on, so a late result of an abandoned round is told apart.
+    int next_id = 0;
+    std::map<int, ClusterWorker> workers;
+    size_t max_workers = std::numeric_limits<size_t>::max();
+    SearchLimits limits;
+    std::shared_ptr<TranspositionTable> table;
+    uint64_t disconnects = 0;
 
-        if ((i + 1 < 8 && j + 1 < 8 && (!go_up || curr_move.piece->is_king))
-            && board[i + 1][j + 1].side == Side::NoOne && curr_move.pieces_eaten.empty()) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i + 1, j + 1);
-            moves.back().is_final = true;
-        }
+    ClusterCoordinator(const SearchLimits &new_limits, size_t hash_megabytes) : limits(new_limits) {
+        table = std::make_shared<TranspositionTable>(hash_megabytes);
+    }
 
-        if ((i + 1 < 8 && j - 1 >= 0 && (!go_up || curr_move.piece->is_king))
-            && board[i + 1][j - 1].side == Side::NoOne && curr_move.pieces_eaten.empty()) {
-            moves.push_back(curr_move);
-            moves.back().fake = false;
-            moves.back().final_position = std::make_pair(i + 1, j - 1);
-            moves.back().is_final = true;
+    ~ClusterCoordinator() {
+        Broadcast("quit\n");
+        for (auto &worker: workers) {
+            close(worker.first);
         }
-
-        if (moves.empty() && !curr_move.fake) {
-            moves.push_back(curr_move);
-            moves.back().is_final = true;
+        if (listener >= 0) {
+            close(listener);
         }
-        return moves;
     }
 
-    void ImplementMove(Move *move) {
-        auto[i_from, j_from] = move->piece->position;
-        auto[i_to, j_to] = move->final_position;
-        Piece &curr_piece = board[i_from][j_from];
-        board[i_to][j_to].side = move->piece->side;
-        board[i_to][j_to].is_king = curr_piece.is_king;
-        board[i_to][j_to].position = std::make_pair(i_to, j_to);
-        curr_piece.side = Side::NoOne;
-        curr_piece.is_king = false;
-        for (Piece *eaten: move->pieces_eaten) {
-            DeletePiece(eaten);
-        }
-        if (board[i_to][j_to].side == Side::User) {
-            auto elem = std::find(user.begin(), user.end(), move->piece);
-            user.erase(elem);
-            user.push_back(&board[move->final_position.first][move->final_position.second]);
-            user.back()->position = std::make_pair(i_to, j_to);
-            if (user.back()->position.first == 0) {
-                user.back()->is_king = true;
-                ++user_kings;
-            }
-        } else {
-            auto elem = std::find(bot.begin(), bot.end(), move->piece);
-            bot.erase(elem);
-            bot.push_back(&board[move->final_position.first][move->final_position.second]);
-            bot.back()->position = std::make_pair(i_to, j_to);
-            if (bot.back()->position.first == 7) {
-                bot.back()->is_king = true;
-                ++bot_kings;
-            }
+    bool Listen(int port) {
+        listener = socket(AF_INET6, SOCK_STREAM, 0);
+        int enable = 1;
+        int disable = 0;
+        sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(uint16_t(port));
+        if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0
+            || setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable)) != 0
+            || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || listen(listener, 64) != 0) {
+            std::cerr << "Cannot listen on port " << port << "\n";
+            return false;
         }
+        fcntl(listener, F_SETFL, O_NONBLOCK);
+        std::cerr << "Coordinating on port " << port << "\n";
+        return true;
     }
 
-    int Score() const {
-        return int(bot.size() - user.size() + (bot_kings - user_kings) / 2);
-    }
-
-    static int SimulateMoveAndScore(const Board &board, const Move &move) {
-        size_t opponent_kings =
-                move.piece->side == Side::User ? board.bot_kings : board.user_kings; //add kings counter to board
-        int eaten_opponent_kings = 0;
-        for (auto &eaten_piece: move.pieces_eaten) {
-            if (eaten_piece->is_king) {
-                ++eaten_opponent_kings;
-            }
+    // Takes every pending connection, returns the number of workers.
+    size_t Accept() {
+        for (int worker; listener >= 0 && (worker = accept(listener, nullptr, nullptr)) >= 0;) {
+            int enable = 1;
+            setsockopt(worker, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            fcntl(worker, F_SETFL, O_NONBLOCK);
+            workers[worker];
         }
-        return int(board.Score() + move.pieces_eaten.size() + (opponent_kings - eaten_opponent_kings) / 2);
+        return workers.size();
     }
 
-    static Move CopyMove(Board &new_board, Move &move_to_copy) {
-        auto[i_pos, j_pos] = move_to_copy.piece->position;
-        Move new_move(&new_board.board[i_pos][j_pos], move_to_copy.final_position, move_to_copy.is_final,
-                      move_to_copy.fake);
-        for (auto &piece: move_to_copy.pieces_eaten) {
-            auto[i_eaten, j_eaten] = piece->position;
-            new_move.pieces_eaten.push_back(&new_board.board[i_eaten][j_eaten]);
+    bool WaitForWorkers(size_t count, int timeout_ms) {
+        auto deadline = Search::Clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (Accept() < count && Search::Clock::now() < deadline) {
+            pollfd polled = {listener, POLLIN, 0};
+            poll(&polled, 1, 100);
         }
-        return new_move;
+        return workers.size() >= count;
     }
 
-    static int MinMaxAI(Board &prev_board, Move &curr_move, int alpha, int beta, int depth, Side side) {
-        auto &this_side_pieces = side == Side::User ? prev_board.user : prev_board.bot;
-        if (depth == 0 || this_side_pieces.empty()) {
-            return SimulateMoveAndScore(prev_board, curr_move);
+    void Broadcast(const std::string &line) {
+        for (auto &worker: workers) {
+            worker.second.output += line;
         }
-        auto board = Board(prev_board);
-        auto move_copy = CopyMove(board, curr_move);
-        board.ImplementMove(&move_copy);
+        Flush();
+    }
 
-        if (side == Side::User) {
-            int max_score = std::numeric_limits<int>::min();
-            auto moves = board.CurrentMoves(Side::Bot);
-            sort(moves.begin(), moves.end(), [&](const Move &lhs, const Move &rhs) {
-                return SimulateMoveAndScore(board, lhs) > SimulateMoveAndScore(board, rhs);
-            });
-            if (moves.empty()) {
-                return SimulateMoveAndScore(prev_board, curr_move);
-            }
-            for (Move &move: moves) {
-                int curr_score = MinMaxAI(board, move, alpha, beta, depth - 1, Side::Bot);
-                max_score = std::max(curr_score, max_score);
-                alpha = std::max(alpha, curr_score);
-                if (beta <= alpha) {
-                    break;
-                }
-            }
-            return max_score;
-        } else {
-            int min_score = std::numeric_limits<int>::max();
-            auto moves = board.CurrentMoves(Side::User);
-            sort(moves.begin(), moves.end(), [&](const Move &lhs, const Move &rhs) {
-                return SimulateMoveAndScore(board, lhs) < SimulateMoveAndScore(board, rhs);
-            });
-            if (moves.empty()) {
-                return SimulateMoveAndScore(prev_board, curr_move);
-            }
-            for (Move &move: moves) {
-                int curr_score = MinMaxAI(board, move, alpha, beta, depth - 1, Side::User);
-                min_score = std::min(curr_score, min_score);
-                beta = std::min(beta, curr_score);
-                if (beta <= alpha) {
+    void Flush() {
+        for (auto &worker: workers) {
+            std::string &output = worker.second.output;
+            while (!output.empty()) {
+                ssize_t count = send(worker.first, output.data(), output.size(), MSG_NOSIGNAL);
+                if (count > 0) {
+                    output.erase(0, size_t(count));
+                } else if (count < 0 && errno == EAGAIN) {
+                    pollfd polled = {worker.first, POLLOUT, 0};
+                    poll(&polled, 1, 100);
+                } else {
                     break;
                 }
             }
-            return min_score;
         }
     }
 
-    bool BotMove() {
-        auto moves = CurrentMoves(Side::Bot);
-        sort(moves.begin(), moves.end(), [&](const Move &lhs, const Move &rhs) {
-            return SimulateMoveAndScore(*this, lhs) > SimulateMoveAndScore(*this, rhs);
-        });
-
-        if (moves.empty()) {
-            return false;
+    void Disconnect(int worker, std::deque<int> *queue, int first_id) {
+        if (workers[worker].unit >= first_id) {
+            queue->push_front(workers[worker].unit - first_id);
         }
+        workers.erase(worker);
+        close(worker);
+        ++disconnects;
+        std::cerr << "Worker disconnected, " << workers.size() << " left\n";
+    }
 
-        std::cout << "Possible moves:\n";
-        for (Move &move: moves) {
-            std::cout << "From (" << move.piece->position.first << ", " << move.piece->position.second << ")"
-                      << " to (" << move.final_position.first << ", " << move.final_position.second << ")\n";
+    // Fills results in the order of units. Gives up once deadline has passed and returns false; the workers
+    // still searching that round get no new unit until they answer, and their answers are dropped.
+    bool Run(std::vector<WorkUnit> units, std::vector<UnitResult> *results,
+             Search::Clock::time_point deadline = Search::Clock::time_point::max()) {
+        results->assign(units.size(), UnitResult());
+        std::deque<int> queue;
+        int first_id = next_id;
+        next_id += int(units.size());
+        for (size_t i = 0; i < units.size(); ++i) {
+            units[i].id = first_id + int(i);
+            queue.push_back(int(i));
         }
-
-        int score = std::numeric_limits<int>::min();
-        Move *chosen_move = nullptr;
-        if (moves.size() != 1) {
-            for (Move &move: moves) {
-                int curr_score = MinMaxAI(*this, move,
-                                          std::numeric_limits<int>::min(),
-                                          std::numeric_limits<int>::max(),
-                                          12,
-                                          Side::Bot);
-                if (curr_score > score) {
-                    chosen_move = &move;
-                    score = curr_score;
+        size_t done = 0;
+        auto orphaned = Search::Clock::now();
+        while (done < units.size()) {
+            auto now = Search::Clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            // Workers get the time left to the deadline, rounded up so they never stop before it.
+            int left_ms = 0;
+            if (deadline != Search::Clock::time_point::max()) {
+                left_ms = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1);
+            }
+            Accept();
+            size_t rank = 0;
+            for (auto &worker: workers) {
+                if (rank++ < max_workers && worker.second.unit < 0 && !queue.empty()) {
+                    WorkUnit &unit = units[size_t(queue.front())];
+                    unit.ms = left_ms;
+                    worker.second.unit = unit.id;
+                    worker.second.output += UnitText(unit);
+                    queue.pop_front();
                 }
             }
-        } else {
-            chosen_move = &moves[0];
-        }
-
-        std::cout << "Made "
-                  << "(" << chosen_move->piece->position.first << ", " << chosen_move->piece->position.second << ") to "
-                  << "(" << chosen_move->final_position.first << ", " << chosen_move->final_position.second << ")\n";
+            Flush();
+            if (!workers.empty()) {
+                orphaned = now;
+            } else if (!queue.empty() && now - orphaned >= std::chrono::milliseconds(kOrphanMs)) {
+                WorkUnit &unit = units[size_t(queue.front())];
+                unit.ms = left_ms;
+                (*results)[size_t(queue.front())] = SearchUnit(unit, limits, table);
+                queue.pop_front();
+                ++done;
+                continue;
+            }
 
-        if (!chosen_move->pieces_eaten.empty()) {
-            std::cout << "Pieces eaten: ";
-            for (auto &eaten_piece: chosen_move->pieces_eaten) {
-                std::cout << "(" << eaten_piece->position.first << ", " << eaten_piece->position.second << ") ";
+            std::vector<pollfd> polled = {{listener, POLLIN, 0}};
+            for (const auto &worker: workers) {
+                polled.push_back({worker.first, POLLIN, 0});
+            }
+            int wait_ms = 100;
+            if (left_ms > 0) {
+                wait_ms = std::min(wait_ms, left_ms);
+            }
+            if (poll(polled.data(), polled.size(), wait_ms) <= 0) {
+                continue;
+            }
+            for (size_t i = 1; i < polled.size(); ++i) {
+                int fd = polled[i].fd;
+                if (!(polled[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                char buffer[65536];
+                ssize_t count = read(fd, buffer, sizeof(buffer));
+                if (count <= 0) {
+                    Disconnect(fd, &queue, first_id);
+                    continue;
+                }
+                ClusterWorker &worker = workers[fd];
+                worker.input.append(buffer, size_t(count));
+                for (size_t end; (end = worker.input.find('\n')) != std::string::npos;) {
+                    int id;
+                    UnitResult result;
+                    bool parsed = ParseResult(worker.input.substr(0, end), &id, &result);
+                    worker.input.erase(0, end + 1);
+                    if (!parsed || id != worker.unit) {
+                        continue;
+                    }
+                    worker.unit = -1;
+                    if (id < first_id) {
+                        continue;
+                    }
+                    for (const auto &entry: result.entries) {
+                        table->Store(entry.first, entry.second);
+                    }
+                    ++worker.units;
+                    worker.nodes += result.nodes;
+                    (*results)[size_t(id - first_id)] = std::move(result);
+                    ++done;
+                }
             }
-            std::cout << "\n";
         }
-
-        ImplementMove(chosen_move);
         return true;
     }
+};
 
-    bool PlayerMove() {
-        auto moves = CurrentMoves(Side::User);
-
-        if (moves.empty()) {
-            return false;
+// Root splitting: every round searches each root move's position as a unit one ply shallower than the round,
+// best moves of the last round first, and hands each unit the entries its previous round brought back. Rounds
+// deepen until the depth limit or, once a round is over, the soft time limit; the round running at the hard time
+// limit is abandoned and the last finished one decides. Returns false when no worker is connected or not even
+// the first round finished.
+inline bool DistributedSearch(ClusterCoordinator &cluster, const Board &root, MoveList &moves,
+                              const SearchLimits &limits, Side side, SearchResult *result) {
+    if (cluster.Accept() == 0) {
+        return false;
+    }
+    auto start = Search::Clock::now();
+    auto deadline = start + std::chrono::milliseconds(limits.hard_ms);
+    std::vector<int> order(moves.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = int(i);
+    }
+    std::vector<TableEntries> known(moves.size());
+    *result = SearchResult();
+    for (int depth = 2; depth <= std::min(limits.max_depth, Search::kMaxPly - 2); ++depth) {
+        std::vector<WorkUnit> units;
+        for (int index: order) {
+            Board child = root;
+            child.ordering = nullptr;
+            child.ImplementMove(&moves[index]);
+            units.push_back({index, child, Opponent(side), depth - 1, known[size_t(index)]});
         }
-
-        std::cout << "Possible moves:\n";
-        for (Move &move: moves) {
-            std::cout << "From (" << move.piece->position.first << ", " << move.piece->position.second << ")"
-                      << " to (" << move.final_position.first << ", " << move.final_position.second << ")\n";
+        std::vector<UnitResult> results;
+        if (!cluster.Run(units, &results, deadline)) {
+            break;
         }
-
-        Move *chosen_move = nullptr;
-        while (chosen_move == nullptr) {
-            std::string from, to;
-            std::cin >> from;
-            std::cin >> to;
-            int i_from = from[0] - 48;
-            int j_from = from[1] - 48;
-            int i_to = to[0] - 48;
-            int j_to = to[1] - 48;
-            for (Move &move: moves) {
-                if (move.piece->position == std::make_pair(i_from, j_from)
-                    && move.final_position == std::make_pair(i_to, j_to)) {
-                    chosen_move = &move;
-                    break;
-                }
+        std::vector<int> scores(moves.size());
+        size_t best = 0;
+        for (size_t i = 0; i < results.size(); ++i) {
+            scores[size_t(order[i])] = results[i].score;
+            known[size_t(order[i])] = results[i].entries;
+            result->nodes += results[i].nodes;
+            if (side == Side::Bot ? results[i].score > results[best].score : results[i].score < results[best].score) {
+                best = i;
             }
-            if (chosen_move == nullptr) {
-                std::cout << "Try again!\n";
+            if (root.table) {
+                for (const auto &entry: results[i].entries) {
+                    root.table->Store(entry.first, entry.second);
+                }
             }
         }
+        result->pv.assign(1, MoveKey(moves[order[best]]));
+        result->pv.insert(result->pv.end(), results[best].pv.begin(), results[best].pv.end());
+        std::stable_sort(order.begin(), order.end(), [&scores, side](int lhs, int rhs) {
+            return side == Side::Bot ? scores[size_t(lhs)] > scores[size_t(rhs)]
+                                     : scores[size_t(lhs)] < scores[size_t(rhs)];
+        });
+        int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(Search::Clock::now() - start).count();
+        result->move_index = order[0];
+        result->score = scores[size_t(order[0])];
+        result->depth = depth;
+        result->iterations.push_back({depth, result->score, result->nodes, ms});
+        if (ms >= limits.soft_ms) {
+            break;
+        }
+    }
+    return result->depth > 0;
+}
 
-        std::cout << "Made "
-                  << "(" << chosen_move->piece->position.first << ", " << chosen_move->piece->position.second << ") to "
-                  << "(" << chosen_move->final_position.first << ", " << chosen_move->final_position.second << ")\n";
-
-        if (!chosen_move->pieces_eaten.empty()) {
-            std::cout << "Pieces eaten: ";
-            for (auto &eaten_piece: chosen_move->pieces_eaten) {
-                std::cout << "(" << eaten_piece->position.first << ", " << eaten_piece->position.second << ") ";
+// Distributed searches of the ReportSpeedup positions with 1, 2, ... of the connected workers, every table
+// cleared before each search. Efficiency is the speedup over one worker divided by the workers used, gain what
+// the last added worker contributed to the speedup.
+inline void RunClusterScaling(ClusterCoordinator &cluster, const Board &board, int depth) {
+    std::vector<Board> positions = {RandomPosition(1, 1), RandomPosition(2, 9), RandomPosition(3, 17)};
+    SearchLimits limits = BenchLimits(cluster.limits, depth, 0);
+    double single_worker_ms = 0;
+    double previous_speedup = 0;
+    std::cout << "workers,time_ms,nodes,nps,speedup,efficiency,gain,best\n";
+    for (size_t count = 1; count <= cluster.workers.size(); ++count) {
+        cluster.max_workers = count;
+        uint64_t nodes = 0;
+        std::string best;
+        auto start = Search::Clock::now();
+        for (Board position: positions) {
+            cluster.Broadcast("clear\n");
+            cluster.table->Clear();
+            position.SetNetwork(board.network);
+            position.tablebase = board.tablebase;
+            auto moves = position.CurrentMoves(Side::Bot);
+            SearchResult result;
+            if (!moves.empty() && DistributedSearch(cluster, position, moves, limits, Side::Bot, &result)) {
+                nodes += result.nodes;
+                best += (best.empty() ? "" : " ") + Board::MoveText(moves[result.move_index]);
             }
-            std::cout << "\n";
         }
+        double ms = std::chrono::duration<double, std::milli>(Search::Clock::now() - start).count();
+        if (count == 1) {
+            single_worker_ms = ms;
+        }
+        double speedup = single_worker_ms / ms;
+        std::cout << count << "," << int64_t(ms) << "," << nodes << "," << uint64_t(nodes / (ms / 1000 + 1e-9)) << ","
+                  << speedup << "," << speedup / double(count) << "," << speedup - previous_speedup << "," << best
+                  << "\n";
+        previous_speedup = speedup;
+    }
+    cluster.max_workers = std::numeric_limits<size_t>::max();
+}
 
-        ImplementMove(chosen_move);
-        return true;
+// One unit per line of "<32 squares> <b|u>" searched at depth, printed as CSV in file order.
+inline bool RunClusterBatch(ClusterCoordinator &cluster, const Board &board, const std::string &path, int depth) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot read " << path << "\n";
+        return false;
     }
-};
+    std::vector<WorkUnit> units;
+    std::string squares;
+    std::string to_move;
+    while (in >> squares >> to_move) {
+        Board position = Board::FromString(squares);
+        position.SetNetwork(board.network);
+        position.tablebase = board.tablebase;
+        units.push_back({0, position, to_move == "b" ? Side::Bot : Side::User, depth, {}});
+    }
+    auto start = Search::Clock::now();
+    std::vector<UnitResult> results;
+    cluster.Run(units, &results);
+    double ms = std::chrono::duration<double, std::milli>(Search::Clock::now() - start).count();
+    uint64_t nodes = 0;
+    std::cout << "position,score,nodes,pv\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        nodes += results[i].nodes;
+        std::string line = EngineProtocol::LineText(units[i].board, units[i].side, results[i].pv);
+        std::cout << i << "," << results[i].score << "," << results[i].nodes << ","
+                  << line.substr(line.empty() ? 0 : 1) << "\n";
+    }
+    std::cerr << units.size() << " positions, " << nodes << " nodes in " << int64_t(ms) << " ms, "
+              << units.size() / (ms / 1000 + 1e-9) << " positions/s, " << cluster.disconnects << " disconnects\n";
+    for (const auto &worker: cluster.workers) {
+        std::cerr << "worker " << worker.first << ": " << worker.second.units << " units, " << worker.second.nodes
+                  << " nodes\n";
+    }
+    return true;
+}
 
 //~~~~
 
@@ -513,22 +4469,108 @@ public:
 class Game {
 public:
     Board new_board;
+    SearchLimits limits;
+    bool ponder;
+    // While the user thinks, the bot searches the position after the reply its last search expected.
+    Board ponder_board;
+    MoveList ponder_moves;
+    SearchResult ponder_result;
+    Search::Clock::time_point ponder_start;
+    std::atomic<bool> ponder_stop;
+    std::atomic<bool> ponder_done;
+    std::thread ponder_thread;
+    // Workers that the bot's moves are split over, see DistributedSearch.
+    std::shared_ptr<ClusterCoordinator> cluster;
+
+    explicit Game(size_t hash_megabytes = 64, SearchLimits new_limits = SearchLimits()) : new_board(Board()),
+                                                                                          limits(new_limits),
+                                                                                          ponder(true),
+                                                                                          ponder_stop(false),
+                                                                                          ponder_done(false) {
+        new_board.table = std::make_shared<TranspositionTable>(hash_megabytes);
+        new_board.ordering = std::make_shared<OrderingTables>();
+    }
+
+    ~Game() {
+        StopPonder();
+    }
+
+    void StartPonder(const SearchResult &result) {
+        if (!ponder || result.pv.size() < 2) {
+            return;
+        }
+        ponder_board = new_board;
+        auto replies = ponder_board.CurrentMoves(Side::User);
+        Move *reply = std::find_if(replies.begin(), replies.end(), [&result](const Move &move) {
+            return result.pv[1].Matches(move);
+        });
+        if (reply == replies.end()) {
+            return;
+        }
+        ponder_board.ImplementMove(reply);
+        ponder_board.ordering = std::make_shared<OrderingTables>(*new_board.ordering);
+        ponder_moves = ponder_board.CurrentMoves(Side::Bot);
+        if (ponder_moves.empty()) {
+            return;
+        }
+
+        SearchLimits ponder_limits = limits;
+        ponder_limits.soft_ms = std::numeric_limits<int>::max();
+        ponder_limits.hard_ms = std::numeric_limits<int>::max();
+        ponder_limits.stop = &ponder_stop;
+        ponder_stop = false;
+        ponder_done = false;
+        ponder_start = Search::Clock::now();
+        ponder_thread = std::thread([this, ponder_limits]() {
+            ponder_result = ParallelSearch(ponder_board, ponder_moves, ponder_limits, Side::Bot);
+            ponder_done = true;
+        });
+    }
+
+    void StopPonder() {
+        ponder_stop = true;
+        if (ponder_thread.joinable()) {
+            ponder_thread.join();
+        }
+    }
 
-    explicit Game() : new_board(Board()) {
+    // Called once the user has moved. On a predicted reply the ponder search is given what is left of the soft
+    // budget and its result is returned in place of a new search, its ordering tables are kept as well.
+    bool FinishPonder() {
+        if (!ponder_thread.joinable()) {
+            return false;
+        }
+        bool hit = ponder_board.Key(Side::Bot) == new_board.Key(Side::Bot);
+        auto soft_deadline = ponder_start + std::chrono::milliseconds(limits.soft_ms);
+        while (hit && !ponder_done && Search::Clock::now() < soft_deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        StopPonder();
+        if (!hit || ponder_result.depth == 0) {
+            return false;
+        }
+        new_board.ordering = ponder_board.ordering;
+        return true;
     }
 
     void PlayGame() {
         while (true) {
+            bool lost = new_board.CurrentMoves(Side::User).empty();
             if (!new_board.PlayerMove()) {
-                std::cout << "AI Win!\n";
+                StopPonder();
+                // PlayerMove also gives up when the input ends, which is not a loss.
+                std::cout << (lost ? "AI Win!\n" : "Aborted\n");
                 break;
             }
+            bool hit = FinishPonder();
             PrintBoard();
-            if (!new_board.BotMove()) {
+            SearchResult result;
+            if (!new_board.BotMove(limits, &result, hit ? &ponder_result : nullptr, cluster.get())) {
                 std::cout << "Player Win!\n";
                 break;
             }
             PrintBoard();
+            StartPonder(result);
         }
     }
 
@@ -541,16 +4583,16 @@ public:
         for (int i = 0; i < 8; ++i) {
             std::cout << i << " ";
             for (int j = 0; j < 8; ++j) {
-                if (new_board.board[i][j].side == Side::NoOne) {
+                if (new_board.SideAt(i, j) == Side::NoOne) {
                     std::cout << "~ ";
                 }
 
-                if (new_board.board[i][j].side == Side::Bot) {
-                    std::cout << (new_board.board[i][j].is_king ? "◓ " : "○ ");
+                if (new_board.SideAt(i, j) == Side::Bot) {
+                    std::cout << (new_board.IsKing(i, j) ? "◓ " : "○ ");
                 }
 
-                if (new_board.board[i][j].side == Side::User) {
-                    std::cout << (new_board.board[i][j].is_king ? "◒ " : "● ");
+                if (new_board.SideAt(i, j) == Side::User) {
+                    std::cout << (new_board.IsKing(i, j) ? "◒ " : "● ");
                 }
             }
             std::cout << "\n";
@@ -560,8 +4602,305 @@ public:
 
 //
 
-int main() {
-    Game game;
+static const char kUsage[] =
+        "usage: checkers [mode [arguments]] [--flag value]...\n"
+        "modes: perft [depth], bench|pvs|selective [depth [nodes]], smp [threads [depth]], tbgen [pieces [threads]],\n"
+        "       bookgen [moves [depth]], selfplay [games [workers [random plies]]], nntrain [records [epochs]],\n"
+        "       nnbench [evaluations], analyse <pdn file> [depth [workers]], server [workers], protocol,\n"
+        "       worker <host> <port>, cluster <port> <workers> [depth [positions file]]; none plays a game\n"
+        "selfplay splits --hash over the two tables of each of its workers, analyse over the table of each\n"
+        "flags: --hash --time --depth --threads --eval --tablebase --book --network --user-depth --user-time\n"
+        "       --user-selective --pvs --aspiration --aspiration-growth --lmr --futility --razoring --quiescence\n"
+        "       --ponder --games --output --blunder --socket --cluster --info-ms --telemetry --trace\n";
+
+int main(int argc, char **argv) {
+    size_t hash_megabytes = 64;
+    std::string tablebase_path = "endgame.tb";
+    bool tablebase_required = false;
+    std::string book_path = "opening.book";
+    bool book_required = false;
+    std::string games_path = "selfplay.txt";
+    // Weights the searches evaluate with, except in nntrain where the path is where the trained network goes.
+    std::string network_path = "eval.nn";
+    bool network_required = false;
+    std::string socket_path = "checkers.sock";
+    std::string output_path = "analysis.col";
+    int blunder = 100;
+    int cluster_port = 0;
+    std::shared_ptr<Network> network;
+    SearchLimits limits;
+    int user_depth = 0;
+    bool ponder = true;
+    std::string user_selective;
+    int user_time = 0;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag.compare(0, 2, "--") != 0) {
+            args.push_back(flag);
+            continue;
+        }
+        if (i + 1 == argc) {
+            std::cerr << "Missing value for " << flag << "\n" << kUsage;
+            return 1;
+        }
+        std::string value = argv[++i];
+        try {
+            if (flag == "--hash") {
+                hash_megabytes = std::stoul(value);
+            } else if (flag == "--time") {
+                limits.SetBudget(std::stoi(value));
+            } else if (flag == "--depth") {
+                limits.max_depth = std::stoi(value);
+            } else if (flag == "--threads") {
+                limits.threads = std::stoi(value);
+            } else if (flag == "--tablebase") {
+                tablebase_path = value;
+                tablebase_required = true;
+            } else if (flag == "--user-depth") {
+                user_depth = std::stoi(value);
+            } else if (flag == "--user-time") {
+                user_time = std::stoi(value);
+            } else if (flag == "--pvs") {
+                limits.pvs = value != "off";
+            } else if (flag == "--aspiration") {
+                limits.aspiration = std::stoi(value);
+            } else if (flag == "--aspiration-growth") {
+                limits.aspiration_growth = std::stoi(value);
+                if (limits.aspiration_growth < 2) {
+                    std::cerr << "--aspiration-growth must be at least 2\n";
+                    return 1;
+                }
+            } else if (flag == "--lmr") {
+                limits.lmr = value != "off";
+            } else if (flag == "--futility") {
+                limits.futility = value != "off";
+            } else if (flag == "--razoring") {
+                limits.razoring = value != "off";
+            } else if (flag == "--quiescence") {
+                limits.quiescence = value != "off";
+            } else if (flag == "--user-selective") {
+                user_selective = value;
+            } else if (flag == "--ponder") {
+                ponder = value != "off";
+            } else if (flag == "--network") {
+                network_path = value;
+                network_required = true;
+            } else if (flag == "--info-ms") {
+                limits.info_ms = std::stoi(value);
+            } else if (flag == "--telemetry") {
+                limits.telemetry_path = value;
+            } else if (flag == "--trace") {
+                limits.trace_path = value;
+            } else if (flag == "--cluster") {
+                cluster_port = std::stoi(value);
+            } else if (flag == "--output") {
+                output_path = value;
+            } else if (flag == "--blunder") {
+                blunder = std::stoi(value);
+            } else if (flag == "--socket") {
+                socket_path = value;
+            } else if (flag == "--games") {
+                games_path = value;
+            } else if (flag == "--book") {
+                book_path = value;
+                book_required = true;
+            } else if (flag == "--eval") {
+                if (!Evaluation::Current().Load(value)) {
+                    std::cerr << "Cannot read evaluation weights from " << value << "\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "Unknown flag " << flag << "\n" << kUsage;
+                return 1;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "Bad value " << value << " for " << flag << "\n" << kUsage;
+            return 1;
+        }
+    }
+    if (!Telemetry::kEnabled && (limits.info_ms || !limits.telemetry_path.empty() || !limits.trace_path.empty())) {
+        std::cerr << "Telemetry is compiled out, rebuild with -DCHECKERS_TELEMETRY=1\n";
+    }
+    std::string mode = args.empty() ? "" : args[0];
+    // How many arguments each mode takes after its name, at least and at most.
+    static const std::map<std::string, std::pair<size_t, size_t>> kArguments = {
+            {"perft", {0, 1}}, {"bench", {0, 2}}, {"selective", {0, 2}}, {"pvs", {0, 2}}, {"tbgen", {0, 2}},
+            {"bookgen", {0, 2}}, {"selfplay", {0, 3}}, {"analyse", {1, 3}}, {"nntrain", {0, 2}},
+            {"nnbench", {0, 1}}, {"server", {0, 1}}, {"protocol", {0, 0}}, {"worker", {2, 2}},
+            {"cluster", {2, 4}}, {"smp", {0, 2}}};
+    if (!args.empty()) {
+        auto arguments = kArguments.find(mode);
+        if (arguments == kArguments.end()) {
+            std::cerr << "Unknown mode " << mode << "\n" << kUsage;
+            return 1;
+        }
+        if (args.size() - 1 < arguments->second.first || args.size() - 1 > arguments->second.second) {
+            std::cerr << "Wrong number of arguments for " << mode << "\n" << kUsage;
+            return 1;
+        }
+    }
+    if (network_required && mode != "nntrain") {
+        auto loaded = std::make_shared<Network>();
+        if (!loaded->Load(network_path)) {
+            std::cerr << "Cannot read network weights from " << network_path << "\n";
+            return 1;
+        }
+        network = loaded;
+    }
+    auto number = [&args](size_t index, long long fallback) {
+        try {
+            return index < args.size() ? std::stoll(args[index]) : fallback;
+        } catch (const std::exception &) {
+            std::cerr << "Bad number " << args[index] << "\n" << kUsage;
+            std::exit(1);
+        }
+    };
+
+    if (mode == "perft") {
+        return RunPerft(int(number(1, 12))) ? 0 : 1;
+    }
+    if (mode == "bench") {
+        RunBench(limits, int(number(1, 12)), uint64_t(number(2, 0)), hash_megabytes, network);
+        return 0;
+    }
+    if (mode == "selective") {
+        CompareSelective(limits, int(number(1, 12)), uint64_t(number(2, 0)), hash_megabytes, network);
+        return 0;
+    }
+    if (mode == "pvs") {
+        ComparePvs(limits, int(number(1, 12)), uint64_t(number(2, 0)), hash_megabytes, network);
+        return 0;
+    }
+    if (mode == "tbgen") {
+        Tablebase tablebase;
+        tablebase.Generate(int(number(1, 4)), int(number(2, std::thread::hardware_concurrency())));
+        if (!tablebase.Save(tablebase_path)) {
+            std::cerr << "Cannot write tablebase to " << tablebase_path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (mode == "bookgen") {
+        OpeningBook book;
+        limits.max_depth = int(number(2, 12));
+        limits.soft_ms = std::numeric_limits<int>::max();
+        limits.hard_ms = std::numeric_limits<int>::max();
+        BuildOpeningBook(book, int(number(1, 4)), limits, hash_megabytes, network);
+        if (!book.Save(book_path)) {
+            std::cerr << "Cannot write opening book to " << book_path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (mode == "selfplay") {
+        SearchLimits user_limits = limits;
+        if (user_depth) {
+            user_limits.max_depth = user_depth;
+        }
+        if (user_time) {
+            user_limits.SetBudget(user_time);
+        }
+        if (!user_selective.empty()) {
+            user_limits.SetSelective(user_selective != "off");
+        }
+        int workers = int(number(2, std::thread::hardware_concurrency()));
+        if (!RunSelfPlay(int(number(1, 100)), workers, int(number(3, 4)), limits, user_limits, hash_megabytes,
+                         games_path, network)) {
+            std::cerr << "Cannot write games to " << games_path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (mode == "analyse") {
+        SearchLimits analysis = BenchLimits(limits, int(number(2, 8)), 0);
+        int workers = int(number(3, std::thread::hardware_concurrency()));
+        return RunAnalysis(args[1], output_path, analysis, workers, hash_megabytes, blunder, network) ? 0 : 1;
+    }
+    if (mode == "nntrain") {
+        std::ifstream records(args.size() > 1 ? args[1] : games_path);
+        NetworkTrainer trainer;
+        std::cerr << trainer.AddRecords(records) << " positions\n";
+        trainer.Run(int(number(2, 10)), 0.01f);
+        Network trained;
+        trainer.Quantise(trained);
+        if (!trained.Save(network_path)) {
+            std::cerr << "Cannot write network to " << network_path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (mode == "nnbench") {
+        Network untrained;
+        if (!network) {
+            NetworkTrainer().Quantise(untrained);
+        }
+        return RunNetworkBench(network ? *network : untrained, int(number(1, 10000000))) ? 0 : 1;
+    }
+    std::shared_ptr<Tablebase> tablebase = std::make_shared<Tablebase>();
+    if (!tablebase->Load(tablebase_path)) {
+        if (tablebase_required) {
+            std::cerr << "Cannot map tablebase " << tablebase_path << "\n";
+            return 1;
+        }
+        tablebase.reset();
+    }
+    std::shared_ptr<OpeningBook> book = std::make_shared<OpeningBook>();
+    if (!book->Load(book_path)) {
+        if (book_required) {
+            std::cerr << "Cannot map opening book " << book_path << "\n";
+            return 1;
+        }
+        book.reset();
+    }
+    if (mode == "server") {
+        GameServer server(limits, hash_megabytes, int(number(1, std::thread::hardware_concurrency())));
+        server.tablebase = tablebase;
+        server.book = book;
+        server.network = network;
+        return server.Run(socket_path) ? 0 : 1;
+    }
+    if (mode == "protocol") {
+        std::ios::sync_with_stdio(false);
+        EngineProtocol protocol(hash_megabytes, limits);
+        protocol.board.SetNetwork(network);
+        protocol.board.tablebase = tablebase;
+        protocol.board.book = book;
+        protocol.Run();
+        return 0;
+    }
+    if (mode == "worker") {
+        return RunClusterWorker(args[1], args[2], limits, hash_megabytes, network) ? 0 : 1;
+    }
+    if (mode == "cluster") {
+        auto cluster = std::make_shared<ClusterCoordinator>(limits, hash_megabytes);
+        Board board;
+        board.SetNetwork(network);
+        board.tablebase = tablebase;
+        if (!cluster->Listen(int(number(1, 0))) || !cluster->WaitForWorkers(size_t(number(2, 1)), 60000)) {
+            std::cerr << "Not enough workers connected\n";
+            return 1;
+        }
+        if (args.size() > 4) {
+            return RunClusterBatch(*cluster, board, args[4], int(number(3, 10))) ? 0 : 1;
+        }
+        RunClusterScaling(*cluster, board, int(number(3, 12)));
+        return 0;
+    }
+    if (mode == "smp") {
+        ReportSpeedup(int(number(1, std::thread::hardware_concurrency())), int(number(2, 12)), hash_megabytes,
+                      network);
+        return 0;
+    }
+    Game game(hash_megabytes, limits);
+    game.ponder = ponder;
+    game.new_board.SetNetwork(network);
+    game.new_board.tablebase = tablebase;
+    game.new_board.book = book;
+    if (cluster_port) {
+        game.cluster = std::make_shared<ClusterCoordinator>(limits, hash_megabytes);
+        game.cluster->Listen(cluster_port);
+    }
     game.PrintBoard();
     game.PlayGame();
     return 0;